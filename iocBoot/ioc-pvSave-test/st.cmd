@@ -55,6 +55,9 @@ pvSave_InitFromDb("test1")
 # Add an IO backend to save/load them
 pvSave_AddPvSetIO("test1", "fsio1")
 
+# Only write the set out when one of its values has changed
+pvSave_SetPvSetMode("test1", "onChange")
+
 # Set the restore stage. Same as autosave pass 1
 pvSave_SetPvSetRestoreStage("test1", "1")
 
@@ -0,0 +1,419 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Binary save file format.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <string.h>
+
+#include "epicsEndian.h"
+
+#include "binaryFormat.h"
+#include "common.h"
+#include "snapshotColumns.h"
+
+using namespace pvsave;
+
+namespace
+{
+
+inline size_t padding(size_t n)
+{
+    return (8 - n % 8) % 8;
+}
+
+inline void pad(std::string& s)
+{
+    s.append(padding(s.size()), '\0');
+}
+
+template<typename T>
+inline void append(std::string& s, const T& v)
+{
+    s.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template<typename T>
+inline T readAt(const char* p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+// Slicing-by-8 tables, table[0] is the classic byte-at-a-time table
+struct CrcTables {
+    uint32_t t[8][256];
+
+    CrcTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+            for (int k = 1; k < 8; ++k)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+    }
+};
+
+const CrcTables s_crc;
+
+/**
+ * Walks the sections of a file whose header and checksum have been validated.
+ * Runs twice: once to check the structure, then again to hand the values to the sink
+ */
+class SectionReader
+{
+public:
+    SectionReader(const char* data, const BinaryHeader& header, const char* fileName) :
+        data_(data), header_(header), fileName_(fileName)
+    {
+    }
+
+    bool readNames();
+    bool walk(RestoreSink* sink);
+
+private:
+    bool fail(const char* what)
+    {
+        LOG_ERR("pvSave: %s: invalid binary save file: %s\n", fileName_, what);
+        return false;
+    }
+
+    bool emitFixed(ETypeCode type, const char* values, const uint32_t* channels, uint32_t count, RestoreSink& sink);
+
+    const char* data_;
+    const BinaryHeader& header_;
+    const char* fileName_;
+    std::vector<const char*> names_;
+    std::vector<uint32_t> nameLengths_;
+    Data value_;                // Reused for every value
+};
+
+bool SectionReader::readNames()
+{
+    const char* p = data_ + sizeof(BinaryHeader);
+    const char* end = p + header_.stringTableBytes;
+    names_.resize(header_.channelCount);
+    nameLengths_.resize(header_.channelCount);
+    for (uint32_t i = 0; i < header_.channelCount; ++i) {
+        const char* nul = static_cast<const char*>(memchr(p, 0, end - p));
+        if (!nul)
+            return fail("string table overrun");
+        names_[i] = p;
+        nameLengths_[i] = uint32_t(nul - p);
+        p = nul + 1;
+    }
+    return true;
+}
+
+bool SectionReader::emitFixed(ETypeCode type, const char* values, const uint32_t* channels, uint32_t count, RestoreSink& sink)
+{
+    const size_t width = ColumnLayout::cellSize(type);
+
+    // Construct the right type once, then only overwrite its bytes
+    switch (type) {
+    case ETypeCode::INT8:    value_.construct<int8_t>(); break;
+    case ETypeCode::UINT8:   value_.construct<uint8_t>(); break;
+    case ETypeCode::INT16:   value_.construct<int16_t>(); break;
+    case ETypeCode::UINT16:  value_.construct<uint16_t>(); break;
+    case ETypeCode::INT32:   value_.construct<int32_t>(); break;
+    case ETypeCode::UINT32:  value_.construct<uint32_t>(); break;
+    case ETypeCode::INT64:   value_.construct<int64_t>(); break;
+    case ETypeCode::UINT64:  value_.construct<uint64_t>(); break;
+    case ETypeCode::FLOAT:   value_.construct<float>(); break;
+    case ETypeCode::DOUBLE:  value_.construct<double>(); break;
+    case ETypeCode::FSTRING: value_.construct<DbString>(); break;
+    default:
+        return fail("unknown section type");
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t ch = readAt<uint32_t>(reinterpret_cast<const char*>(channels + i));
+        memcpy(value_.data(), values + i * width, width);
+        if (type == ETypeCode::FSTRING)
+            value_.get<DbString>()->normalize();
+        sink.onData(names_[ch], nameLengths_[ch], value_);
+    }
+    return true;
+}
+
+bool SectionReader::walk(RestoreSink* sink)
+{
+    const char* p = data_ + sizeof(BinaryHeader) + header_.stringTableBytes;
+    const char* end = data_ + sizeof(BinaryHeader) + header_.payloadBytes;
+
+    for (uint32_t s = 0; s < header_.sectionCount; ++s) {
+        if (size_t(end - p) < sizeof(BinarySection))
+            return fail("truncated section header");
+        const auto section = readAt<BinarySection>(p);
+        p += sizeof(BinarySection);
+
+        const size_t indexBytes = size_t(section.count) * sizeof(uint32_t);
+        if (size_t(end - p) < indexBytes + padding(indexBytes))
+            return fail("truncated channel index");
+        const uint32_t* channels = reinterpret_cast<const uint32_t*>(p);
+        p += indexBytes + padding(indexBytes);
+
+        if (uint64_t(end - p) < section.valueBytes)
+            return fail("truncated values");
+        const char* values = p;
+        const char* valuesEnd = p + section.valueBytes;
+        p = valuesEnd;
+
+        if (!sink) {
+            for (uint32_t i = 0; i < section.count; ++i)
+                if (readAt<uint32_t>(reinterpret_cast<const char*>(channels + i)) >= header_.channelCount)
+                    return fail("channel index out of range");
+        }
+
+        const ETypeCode type = ETypeCode(section.type);
+        if (const size_t width = ColumnLayout::cellSize(type)) {
+            if (section.valueBytes < uint64_t(width) * section.count)
+                return fail("fixed width section too short");
+            if (sink && !emitFixed(type, values, channels, section.count, *sink))
+                return false;
+            continue;
+        }
+
+        // Variable width values are walked one by one in both passes
+        const char* v = values;
+        for (uint32_t i = 0; i < section.count; ++i) {
+            const uint32_t ch = readAt<uint32_t>(reinterpret_cast<const char*>(channels + i));
+            if (type == ETypeCode::STRING) {
+                if (size_t(valuesEnd - v) < sizeof(uint32_t))
+                    return fail("truncated string");
+                const uint32_t len = readAt<uint32_t>(v);
+                v += sizeof(uint32_t);
+                if (size_t(valuesEnd - v) < len)
+                    return fail("truncated string");
+                if (sink) {
+                    if (!value_.is<std::string>())
+                        value_.construct<std::string>();
+                    value_.get<std::string>()->assign(v, len);
+                    sink->onData(names_[ch], nameLengths_[ch], value_);
+                }
+                v += len;
+            }
+            else if (type == ETypeCode::ARRAY) {
+                if (size_t(valuesEnd - v) < 2 * sizeof(uint32_t))
+                    return fail("truncated array");
+                const ETypeCode elemType = ETypeCode(readAt<uint16_t>(v));
+                const uint32_t count = readAt<uint32_t>(v + sizeof(uint32_t));
+                v += 2 * sizeof(uint32_t);
+                const size_t bytes = size_t(count) * elementSize(elemType);
+                if (!elementSize(elemType) || size_t(valuesEnd - v) < bytes)
+                    return fail("bad array");
+                if (sink) {
+                    if (!value_.is<DataArray>())
+                        value_.construct<DataArray>();
+                    auto* arr = value_.get<DataArray>();
+                    arr->resize(elemType, count);
+                    memcpy(arr->data(), v, bytes);
+                    sink->onData(names_[ch], nameLengths_[ch], value_);
+                }
+                v += bytes;
+            }
+            else
+                return fail("unknown section type");
+        }
+    }
+
+    if (p != end)
+        return fail("trailing data after the last section");
+    return true;
+}
+
+} // namespace
+
+uint32_t pvsave::crc32(uint32_t crc, const void* data, size_t len)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const auto& t = s_crc.t;
+    crc = ~crc;
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    for (; len >= 8; len -= 8, p += 8) {
+        const uint32_t lo = readAt<uint32_t>(reinterpret_cast<const char*>(p)) ^ crc;
+        const uint32_t hi = readAt<uint32_t>(reinterpret_cast<const char*>(p) + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+#endif
+    for (; len; --len, ++p)
+        crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void BinaryWriter::clear()
+{
+    names_.clear();
+    channelCount_ = 0;
+    for (auto& section : sections_) {
+        section.channels.clear();
+        section.values.clear();
+    }
+}
+
+bool BinaryWriter::add(const std::string& channelName, const Data& value)
+{
+    const ETypeCode type = value.type_code();
+    if (type >= ETypeCode::OTHER)
+        return false;
+
+    auto& section = sections_[size_t(type)];
+    if (const size_t width = ColumnLayout::cellSize(type)) {
+        // Numbers and DbString sit at the start of the variant's buffer
+        section.values.append(static_cast<const char*>(value.data()), width);
+    }
+    else if (auto* str = value.get<std::string>()) {
+        append(section.values, uint32_t(str->size()));
+        section.values.append(*str);
+    }
+    else if (auto* arr = value.get<DataArray>()) {
+        append(section.values, uint16_t(arr->elementType()));
+        append(section.values, uint16_t(0));
+        append(section.values, uint32_t(arr->size()));
+        section.values.append(static_cast<const char*>(arr->data()), arr->bytes());
+    }
+    else
+        return false;
+
+    section.channels.push_back(channelCount_++);
+    names_.append(channelName.c_str(), channelName.size() + 1);
+    return true;
+}
+
+const std::string& BinaryWriter::finish()
+{
+    BinaryHeader header = {};
+    memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.byteOrder = BINARY_BYTE_ORDER;
+    header.channelCount = channelCount_;
+
+    out_.clear();
+    out_.append(sizeof(header), '\0');  // Filled in once the sizes are known
+
+    out_.append(names_);
+    pad(out_);
+    header.stringTableBytes = uint32_t(out_.size() - sizeof(header));
+
+    for (size_t t = 0; t < sections_.size(); ++t) {
+        auto& section = sections_[t];
+        if (section.channels.empty())
+            continue;
+        ++header.sectionCount;
+
+        BinarySection sh = {};
+        sh.type = uint16_t(t);
+        sh.count = uint32_t(section.channels.size());
+        sh.valueBytes = section.values.size() + padding(section.values.size());
+        append(out_, sh);
+        out_.append(reinterpret_cast<const char*>(section.channels.data()), section.channels.size() * sizeof(uint32_t));
+        pad(out_);
+        out_.append(section.values);
+        pad(out_);
+    }
+
+    header.payloadBytes = out_.size() - sizeof(header);
+    memcpy(&out_[0], &header, sizeof(header));
+    append(out_, crc32(0, out_.data(), out_.size()));
+    return out_;
+}
+
+bool pvsave::readBinary(const char* data, size_t len, RestoreSink& sink, const char* fileName)
+{
+    if (len < sizeof(BinaryHeader) + sizeof(uint32_t)) {
+        LOG_ERR("pvSave: %s: invalid binary save file: too short\n", fileName);
+        return false;
+    }
+
+    const auto header = readAt<BinaryHeader>(data);
+    if (memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0) {
+        LOG_ERR("pvSave: %s: not a binary save file\n", fileName);
+        return false;
+    }
+    if (header.byteOrder != BINARY_BYTE_ORDER) {
+        LOG_ERR("pvSave: %s: binary save file was written by a host of different byte order\n", fileName);
+        return false;
+    }
+    if (header.version != BINARY_VERSION) {
+        LOG_ERR("pvSave: %s: unsupported binary save file version %u\n", fileName, unsigned(header.version));
+        return false;
+    }
+    if (header.payloadBytes != len - sizeof(BinaryHeader) - sizeof(uint32_t) || header.stringTableBytes > header.payloadBytes) {
+        LOG_ERR("pvSave: %s: invalid binary save file: size mismatch, file is truncated?\n", fileName);
+        return false;
+    }
+
+    const uint32_t crc = readAt<uint32_t>(data + len - sizeof(uint32_t));
+    if (crc32(0, data, len - sizeof(uint32_t)) != crc) {
+        LOG_ERR("pvSave: %s: invalid binary save file: checksum mismatch\n", fileName);
+        return false;
+    }
+
+    SectionReader reader(data, header, fileName);
+    return reader.readNames() && reader.walk(nullptr) && reader.walk(&sink);
+}
+
+size_t pvsave::binaryFileSize(const char* data, size_t len)
+{
+    if (len < sizeof(BinaryHeader))
+        return 0;
+    const auto header = readAt<BinaryHeader>(data);
+    if (memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0)
+        return 0;
+    return sizeof(BinaryHeader) + header.payloadBytes + sizeof(uint32_t);
+}
+
+bool pvsave::readJournal(const char* data, size_t len, RestoreSink& sink, const char* fileName)
+{
+    // A header that claims more than there is gets reported by readBinary
+    const size_t snapshotBytes = binaryFileSize(data, len);
+    const size_t base = snapshotBytes && snapshotBytes <= len ? snapshotBytes : len;
+    if (!readBinary(data, base, sink, fileName))
+        return false;
+
+    const char* p = data + base;
+    const char* const end = data + len;
+    uint64_t cycle = 0;
+    while (p < end) {
+        if (size_t(end - p) < sizeof(JournalRecord)) {
+            LOG_WARN("pvSave: %s: journal ends in an incomplete record after cycle %llu\n", fileName, (unsigned long long)cycle);
+            break;
+        }
+        const auto record = readAt<JournalRecord>(p);
+        if (memcmp(record.magic, JOURNAL_MAGIC, sizeof(record.magic)) != 0 || record.cycle != cycle + 1) {
+            LOG_WARN("pvSave: %s: invalid journal record after cycle %llu, ignoring the rest\n", fileName, (unsigned long long)cycle);
+            break;
+        }
+        p += sizeof(JournalRecord);
+        if (size_t(end - p) < record.bytes) {
+            LOG_WARN("pvSave: %s: journal ends in an incomplete record for cycle %llu\n", fileName, (unsigned long long)record.cycle);
+            break;
+        }
+        // Nothing is passed on from a record that fails validation
+        if (!readBinary(p, record.bytes, sink, fileName)) {
+            LOG_WARN("pvSave: %s: ignoring the journal from cycle %llu on\n", fileName, (unsigned long long)record.cycle);
+            break;
+        }
+        p += record.bytes;
+        cycle = record.cycle;
+    }
+
+    LOG_DBG("pvSave: %s: replayed %llu journal cycles\n", fileName, (unsigned long long)cycle);
+    return true;
+}
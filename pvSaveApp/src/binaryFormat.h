@@ -0,0 +1,144 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Binary save file format.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "pvsave/pvSave.h"
+
+namespace pvsave
+{
+
+/**
+ * Layout of a binary save file. All integers are in the byte order of the host that wrote the file,
+ * readers reject files of the other byte order.
+ *
+ *   BinaryHeader
+ *   String table   channelCount NUL terminated channel names, padded to 8 bytes
+ *   Sections       sectionCount times:
+ *                    BinarySection
+ *                    uint32_t channel[count]     Index into the string table, padded to 8 bytes
+ *                    values                      See below, padded to 8 bytes
+ *   uint32_t crc    CRC-32 of everything before it
+ *
+ * Each section holds all values of one type. Numbers and DBF_STRING values are fixed width, count * width bytes.
+ * Long strings are a uint32_t length followed by the bytes. Arrays are a uint16_t element type, 2 bytes of
+ * padding and a uint32_t element count, followed by the elements.
+ * Type codes are ETypeCode values, so those must never be renumbered.
+ */
+struct BinaryHeader {
+    char magic[8];              // BINARY_MAGIC
+    uint16_t version;           // BINARY_VERSION
+    uint16_t byteOrder;         // BINARY_BYTE_ORDER as written by the host
+    uint32_t channelCount;
+    uint32_t sectionCount;
+    uint32_t stringTableBytes;  // Including padding
+    uint64_t payloadBytes;      // Everything between the header and the crc
+};
+
+struct BinarySection {
+    uint16_t type;              // ETypeCode of the values
+    uint16_t reserved;
+    uint32_t count;             // Number of values
+    uint64_t valueBytes;        // Size of the values, including padding
+};
+
+/**
+ * Journal files start with a binary save file holding the last compacted snapshot, followed by one record per write
+ * cycle with only the channels that changed in that cycle:
+ *
+ *   JournalRecord
+ *   Binary save file   bytes long, with its own header and crc
+ *
+ * Restoring replays the snapshot and then every record in order, so later values win. A record that is incomplete
+ * or fails its checks (the IOC died while appending it) ends the journal.
+ */
+struct JournalRecord {
+    char magic[4];              // JOURNAL_MAGIC
+    uint32_t bytes;             // Size of the binary save file that follows
+    uint64_t cycle;             // Number of the write cycle since the snapshot, starting at 1
+};
+
+constexpr char BINARY_MAGIC[8] = {'P', 'V', 'S', 'A', 'V', 'E', 'B', '\0'};
+constexpr uint16_t BINARY_VERSION = 1;
+constexpr uint16_t BINARY_BYTE_ORDER = 0x0102;
+constexpr char JOURNAL_MAGIC[4] = {'P', 'V', 'S', 'J'};
+
+/**
+ * \brief Returns the CRC-32 (IEEE 802.3, as used by zlib) of a buffer
+ * \param crc CRC of the preceding data, 0 to start
+ */
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
+
+/**
+ * \brief Builds a binary save file in memory
+ * Values are collected by type as they are added, and laid out into sections by finish().
+ * Buffers are kept between files, so saving the same set over and over doesn't allocate.
+ */
+class BinaryWriter
+{
+public:
+    void clear();
+
+    /**
+     * \brief Add a channel's value
+     * \returns False if the type of value can't be stored
+     */
+    bool add(const std::string& channelName, const Data& value);
+
+    /**
+     * \brief Lay out the file, including the checksum
+     * \returns The file contents. Valid until the next call to clear() or add()
+     */
+    const std::string& finish();
+
+private:
+    struct Section {
+        std::vector<uint32_t> channels;
+        std::string values;
+    };
+
+    std::string names_;         // String table
+    uint32_t channelCount_ = 0;
+    std::vector<Section> sections_ = std::vector<Section>(size_t(ETypeCode::OTHER));  // Indexed by ETypeCode
+    std::string out_;
+};
+
+/**
+ * \brief Validate a binary save file and pass its values to sink
+ * \param data File contents
+ * \param len Size of data
+ * \param fileName For error messages
+ * \returns False if the file is invalid. Nothing is passed to the sink in that case
+ */
+bool readBinary(const char* data, size_t len, RestoreSink& sink, const char* fileName);
+
+/**
+ * \brief Returns the size of the binary save file at the start of data, as given by its header
+ * \returns 0 if data doesn't start with a binary save file header
+ */
+size_t binaryFileSize(const char* data, size_t len);
+
+/**
+ * \brief Validate a journal file and pass its snapshot, then the changes of every complete cycle, to sink
+ * \returns False if the snapshot is invalid. A damaged tail only ends the replay early
+ */
+bool readJournal(const char* data, size_t len, RestoreSink& sink, const char* fileName);
+
+} // namespace pvsave
@@ -0,0 +1,133 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Name to channel lookup that works on non-terminated name views
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "pvsave/pvSave.h"
+
+namespace pvsave
+{
+
+/**
+ * \brief Read-only hash index from channel name to position.
+ * Open addressing over a flat table, so lookups by (pointer, length) need no std::string and no node allocations.
+ * The indexed names must outlive the index.
+ */
+class ChannelIndex
+{
+public:
+    static constexpr size_t npos = size_t(-1);
+
+    void build(const std::vector<DataSource::Channel>& channels)
+    {
+        names_.clear();
+        names_.reserve(channels.size());
+        for (auto& chan : channels)
+            names_.push_back(&chan.channelName);
+        rehash();
+    }
+
+    void build(const std::vector<std::string>& names)
+    {
+        names_.clear();
+        names_.reserve(names.size());
+        for (auto& name : names)
+            names_.push_back(&name);
+        rehash();
+    }
+
+    size_t size() const { return names_.size(); }
+
+    /**
+     * \brief Find a name
+     * \param name Name, need not be NUL terminated
+     * \param len Length of name
+     * \param hint Position to check first. Save files are usually in channel order, so pass the last result + 1
+     * \returns Position of the name, or npos if not found
+     */
+    size_t find(const char* name, size_t len, size_t hint = npos) const
+    {
+        if (hint < names_.size() && equals(*names_[hint], name, len))
+            return hint;
+        if (slots_.empty())
+            return npos;
+
+        const uint32_t h = hash(name, len);
+        for (size_t s = h & mask_;; s = (s + 1) & mask_) {
+            const Slot& slot = slots_[s];
+            if (slot.index == EMPTY)
+                return npos;
+            if (slot.hash == h && equals(*names_[slot.index], name, len))
+                return slot.index;
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY = uint32_t(-1);
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    // FNV-1a
+    static uint32_t hash(const char* p, size_t len)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; ++i)
+            h = (h ^ uint8_t(p[i])) * 16777619u;
+        return h;
+    }
+
+    static bool equals(const std::string& a, const char* b, size_t len)
+    {
+        return a.size() == len && memcmp(a.data(), b, len) == 0;
+    }
+
+    void rehash()
+    {
+        // Keep the load factor at or below 0.5
+        size_t cap = 16;
+        while (cap < names_.size() * 2)
+            cap <<= 1;
+        mask_ = cap - 1;
+        slots_.assign(cap, Slot{0, EMPTY});
+
+        for (uint32_t i = 0; i < names_.size(); ++i) {
+            const uint32_t h = hash(names_[i]->data(), names_[i]->size());
+            size_t s = h & mask_;
+            while (slots_[s].index != EMPTY) {
+                // First one wins on duplicates, like the unordered_map insert this replaces
+                if (slots_[s].hash == h && *names_[slots_[s].index] == *names_[i])
+                    break;
+                s = (s + 1) & mask_;
+            }
+            if (slots_[s].index == EMPTY)
+                slots_[s] = Slot{h, i};
+        }
+    }
+
+    std::vector<const std::string*> names_;
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+};
+
+} // namespace pvsave
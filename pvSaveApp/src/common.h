@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <stddef.h>
+
 #include <dbAccess.h>
 #include <errlog.h>
 
@@ -47,12 +50,25 @@ IOSCANPVT* statusIoScan();
  */
 epicsTimeStamp lastProcTime(int ms = -1);
 
+/**
+ * Returns the time at which the data of the specified monitor set last changed
+ * if -1, returns the most recent change of any monitor set
+ */
+epicsTimeStamp lastChangedTime(int ms = -1);
+
 /**
  * Returns the last status for the specified monitor set
  * if -1, returns last proc time for any monitor set
  */
 int lastStatus(int ms = -1);
 
+/**
+ * Number of times a buffer grew while capturing snapshots: a new snapshot buffer for the pool, or an array slot
+ * that had to be resized for a larger field. Only counts those two sites in the capture path, not every heap
+ * allocation made by the save or writer threads. Stays constant once the save cycle has warmed up
+ */
+std::atomic<size_t>& captureBufferGrowth();
+
 /**
  * Current logging level
  */
@@ -13,11 +13,19 @@
  * LICENSE.txt file.
  * ----------------------------------------------------------------------------
  **/
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
 #include "dbAccess.h"
 #include "dbAddr.h"
+#include "dbChannel.h"
 #include "dbCommon.h"
+#include "dbEvent.h"
+#include "dbLock.h"
 #include "dbStaticLib.h"
 #include "epicsStdio.h"
+#include "epicsThread.h"
 
 #include "common.h"
 #include "pvsave/pvSave.h"
@@ -25,6 +33,8 @@
 namespace pvsave
 {
 
+static_assert(sizeof(DbString) == MAX_STRING_SIZE, "DbString must match MAX_STRING_SIZE");
+
 /**
  * Implements a data source for interacting with EPICS V3 DB
  */
@@ -35,13 +45,44 @@ public:
     void connect(const std::vector<std::string> &pvList, std::vector<Channel> &outChannels) override;
     void put(const Channel &channel, const Data &pvData) override;
     void get(const Channel &channel, Data &pvData) override;
+    void putMany(const Channel *channels, const Data *pvData, size_t count) override;
+    void getMany(const Channel *channels, Data *pvData, size_t count) override;
+    bool subscribe(const std::vector<Channel> &channels, ChangeTracker &tracker) override;
+    void group(std::vector<Channel> &channels) override;
+    ETypeCode channelType(const Channel &channel) const override;
 
 private:
+    /**
+     * All records of one lockset (as of group()), locked together with dbScanLockMany
+     * dbLocker tracks lockset splits/merges itself, so this stays correct if the locksets change later
+     */
+    struct LockGroup {
+        dbLocker *locker = nullptr;
+    };
+
     struct ContextData {
+        LockGroup *group = nullptr;
         dbAddr addr = {};
         DBENTRY entry = {};
+        dbChannel *chan = nullptr;
+        dbEventSubscription sub = nullptr;
+        ChangeTracker *tracker = nullptr;
+        size_t index = 0;
+        ETypeCode type = ETypeCode::VOID; // Type of Data that get() produces for this field
+        ETypeCode elemType = ETypeCode::VOID; // Element type if type is ARRAY
     };
-    std::vector<ContextData> addrs_;
+
+    class RunLock;
+
+    void putLocked(ContextData *pctx, const Data &data);
+    void getLocked(ContextData *pctx, Data &data);
+
+    static void eventCallback(void *userArg, dbChannel *chan, int eventsRemaining, db_field_log *pfl);
+
+    // deque so that pointers handed out as Channel::contextData stay valid across connect() calls
+    std::deque<ContextData> addrs_;
+    std::deque<LockGroup> groups_;
+    dbEventCtx eventCtx_ = nullptr;
 };
 
 bool DataSourceCA::init() { return true; }
@@ -51,7 +92,7 @@ Data dataFromDbfType(short type)
     Data d;
     switch (type) {
     case DBF_STRING:
-        d.construct<std::string>();
+        d.construct<DbString>();
         return d;
     case DBF_CHAR:
         d.construct<int8_t>();
@@ -83,11 +124,10 @@ Data dataFromDbfType(short type)
     case DBF_DOUBLE:
         d.construct<double>();
         return d;
+    // DBR_ENUM is an epicsEnum16, scalars and array elements must be read into two bytes
     case DBF_ENUM:
-        d.construct<int>();
-        return d;
     case DBF_MENU:
-        d.construct<int>();
+        d.construct<uint16_t>();
         return d;
     case DBF_DEVICE:
     case DBF_INLINK:
@@ -98,36 +138,70 @@ Data dataFromDbfType(short type)
     }
 }
 
+/**
+ * Returns the DBR type matching a scalar or array element type code, or -1 if there is none
+ */
+static short dbrTypeFromCode(ETypeCode code)
+{
+    switch (code) {
+    case ETypeCode::INT8:   return DBR_CHAR;
+    case ETypeCode::UINT8:  return DBR_UCHAR;
+    case ETypeCode::INT16:  return DBR_SHORT;
+    case ETypeCode::UINT16: return DBR_USHORT;
+    case ETypeCode::INT32:  return DBR_LONG;
+    case ETypeCode::UINT32: return DBR_ULONG;
+    case ETypeCode::INT64:  return DBR_INT64;
+    case ETypeCode::UINT64: return DBR_UINT64;
+    case ETypeCode::FLOAT:  return DBR_FLOAT;
+    case ETypeCode::DOUBLE: return DBR_DOUBLE;
+    case ETypeCode::STRING: return DBR_STRING;
+    default:                return -1;
+    }
+}
+
 void DataSourceCA::connect(const std::vector<std::string> &pvList, std::vector<Channel> &outChannels)
 {
-    addrs_.resize(pvList.size());
     for (size_t i = 0; i < pvList.size(); ++i) {
         auto &pv = pvList[i];
-        if (dbNameToAddr(pv.c_str(), &addrs_[i].addr) != 0) {
+        ContextData ctx;
+        if (dbNameToAddr(pv.c_str(), &ctx.addr) != 0) {
             printf("Failed to connect channel %s\n", pv.c_str());
-            addrs_[i] = {};
         } else {
             // printf("Connected %s\n", pv.c_str());
-            dbInitEntry(pdbbase, &addrs_[i].entry);
-            outChannels.push_back({pv, &addrs_[i]});
+            ctx.type = dataFromDbfType(ctx.addr.dbr_field_type).type_code();
+            // Waveforms, aai/aao and long strings (NAME.FIELD$) have more than one element
+            if (ctx.addr.no_elements > 1 && ctx.type != ETypeCode::FSTRING && elementSize(ctx.type)) {
+                ctx.elemType = ctx.type;
+                ctx.type = ETypeCode::ARRAY;
+            }
+            // DataArray only holds numeric elements, so string waveforms are saved as a single DbString
+            else if (ctx.addr.no_elements > 1 && ctx.type == ETypeCode::FSTRING) {
+                LOG_WARN("pvSave: %s is an array of %ld strings, only element 0 is saved and restored\n",
+                    pv.c_str(), long(ctx.addr.no_elements));
+            }
+            addrs_.push_back(ctx);
+            dbInitEntry(pdbbase, &addrs_.back().entry);
+            outChannels.push_back({pv, &addrs_.back()});
         }
     }
     printf("Connected %zu out of %zu PVs (%2.f%%)\n", 
         outChannels.size(), pvList.size(), 100.f * float(outChannels.size()) / pvList.size());
 }
 
-void DataSourceCA::put(const Channel &channel, const Data &data)
+/**
+ * Put a single channel. Caller must hold the record's scan lock
+ */
+void DataSourceCA::putLocked(ContextData *pctx, const Data &data)
 {
-    auto *pdb = static_cast<dbAddr *>(channel.contextData);
+    auto *pdb = &pctx->addr;
 
-    printf("put attempt for %s\n", channel.channelName.c_str());
+    LOG_TRACE("put attempt for %s\n", pdb->precord->name);
 
-    /** Channel not connected or no data to restore */
-    if (!pdb || data.is<void>()) {
+    /** No data to restore */
+    if (data.is<void>()) {
         return;
     }
 
-    auto *pctx = static_cast<ContextData *>(channel.contextData);
     if (!pctx->entry.pdbbase) {
         dbInitEntryFromAddr(pdb, &pctx->entry);
         dbInitEntry(pdbbase, &pctx->entry);
@@ -135,51 +209,272 @@ void DataSourceCA::put(const Channel &channel, const Data &data)
 
     long result;
 
-    dbAutoScanLock al(pdb->precord);
+    /** Arrays are put in one go, dbPut truncates to the field's capacity */
+    if (auto *arr = data.get<DataArray>()) {
+        short dbrType = dbrTypeFromCode(arr->elementType());
+        if (dbrType < 0 || (result = dbPutField(pdb, dbrType, arr->data(), arr->size())) != 0) {
+            printf("DataSourceCA::put: dbPutField() failed for %s\n", pdb->precord->name);
+        }
+        return;
+    }
 
-    /** Special handling for string since we cannot directly memcpy std::string in there */
-    if (pdb->dbr_field_type == DBR_STRING) {
-        auto val = data.value<std::string>();
-        if ((result = dbPutField(pdb, pdb->dbr_field_type, val.c_str(), val.size()))) {
+    /** Strings are put as one DBR_STRING, the database converts them if the field isn't a string */
+    if (auto *fs = data.get<DbString>()) {
+        if ((result = dbPutField(pdb, DBR_STRING, fs->c_str(), 1)) != 0) {
+            printf("DataSourceCA::put: dbPutField() failed: %ld\n", result);
+        }
+    } else if (auto *str = data.get<std::string>()) {
+        // Only comes from save data with strings too long for a DBF_STRING; put what fits
+        DbString val;
+        val.assign(str->c_str(), str->size());
+        if ((result = dbPutField(pdb, DBR_STRING, val.c_str(), 1)) != 0) {
             printf("DataSourceCA::put: dbPutField() failed: %ld\n", result);
         }
     } else {
-        if ((result = dbPutField(pdb, pdb->dbr_field_type, data.data(), 1)) != 0) {
+        // Put as the type of the saved value, the database converts it if the field type changed since
+        short dbrType = dbrTypeFromCode(data.type_code());
+        if (dbrType < 0)
+            dbrType = pdb->dbr_field_type;
+        if ((result = dbPutField(pdb, dbrType, data.data(), 1)) != 0) {
             printf("DataSourceCA::put: dbPutField() failed: %ld\n", result);
             return;
         }
     }
 }
 
-void DataSourceCA::get(const Channel &channel, Data &data)
+/**
+ * Get a single channel. Caller must hold the record's scan lock, so this uses dbGet rather than dbGetField
+ */
+void DataSourceCA::getLocked(ContextData *pdb, Data &data)
 {
-    auto *pdb = static_cast<ContextData *>(channel.contextData);
-    data = dataFromDbfType(pdb->addr.dbr_field_type);
+    // Only (re)construct if the slot holds another type. Callers reuse their slots, so this keeps the steady state allocation-free
+    if (data.type_code() != pdb->type) {
+        if (pdb->type == ETypeCode::ARRAY)
+            data.construct<DataArray>();
+        else
+            data = dataFromDbfType(pdb->addr.dbr_field_type);
+    }
 
     long result;
 
-    dbAutoScanLock al(pdb->addr.precord);
+    /** Arrays are read in bulk. The buffer is sized for the whole field once and reused afterwards */
+    if (auto *arr = data.get<DataArray>()) {
+        if (arr->reserve(pdb->elemType, pdb->addr.no_elements))
+            ++captureBufferGrowth();
 
-    /** Special handling for string fields */
-    if (pdb->addr.dbr_field_type == DBR_STRING) {
-        char buf[MAX_STRING_SIZE + 1];
-        buf[0] = 0;
-
-        long req = sizeof(buf);
-        if ((result = dbGetField(&pdb->addr, pdb->addr.dbr_field_type, buf, nullptr, &req, nullptr)) != 0) {
+        long req = pdb->addr.no_elements;
+        if ((result = dbGet(&pdb->addr, pdb->addr.dbr_field_type, arr->data(), nullptr, &req, nullptr)) != 0) {
             printf("DataSourceCA::get: dbGet() failed: %li\n", result);
+            arr->resize(pdb->elemType, 0);
             return;
         }
+        arr->resize(pdb->elemType, req); // Number of valid elements, i.e. NORD
+        return;
+    }
 
-        *data.get<std::string>() = buf;
+    /** Strings are read straight into the inline buffer */
+    if (auto *fs = data.get<DbString>()) {
+        long req = 1;
+        if ((result = dbGet(&pdb->addr, DBR_STRING, fs->data(), nullptr, &req, nullptr)) != 0) {
+            printf("DataSourceCA::get: dbGet() failed: %li\n", result);
+            return;
+        }
+        // dbGet doesn't always pad, and DbString is compared bitwise
+        fs->normalize();
     } else {
-        if ((result = dbGetField(&pdb->addr, pdb->addr.dbr_field_type, data.data(), nullptr, nullptr, nullptr)) != 0) {
+        if ((result = dbGet(&pdb->addr, pdb->addr.dbr_field_type, data.data(), nullptr, nullptr, nullptr)) != 0) {
             printf("DataSourceCA::get: dbGet() failed: %li\n", result);
             return;
         }
     }
 }
 
+void DataSourceCA::put(const Channel &channel, const Data &data)
+{
+    putMany(&channel, &data, 1);
+}
+
+void DataSourceCA::get(const Channel &channel, Data &data)
+{
+    getMany(&channel, &data, 1);
+}
+
+ETypeCode DataSourceCA::channelType(const Channel &channel) const
+{
+    auto *pctx = static_cast<const ContextData *>(channel.contextData);
+    return pctx ? pctx->type : ETypeCode::VOID;
+}
+
+/**
+ * Scan lock held over a run of channels in putMany/getMany.
+ * Channels of the same lock group share one dbScanLockMany, ungrouped channels fall back to per-record locks
+ */
+class DataSourceCA::RunLock
+{
+    LockGroup *group_ = nullptr;
+    dbCommon *record_ = nullptr;
+
+public:
+    ~RunLock() { release(); }
+
+    void acquire(const ContextData *pctx)
+    {
+        if (pctx->group) {
+            if (pctx->group == group_)
+                return;
+            release();
+            group_ = pctx->group;
+            dbScanLockMany(group_->locker);
+        } else {
+            if (!group_ && pctx->addr.precord == record_)
+                return;
+            release();
+            record_ = pctx->addr.precord;
+            dbScanLock(record_);
+        }
+    }
+
+    void release()
+    {
+        if (group_)
+            dbScanUnlockMany(group_->locker);
+        else if (record_)
+            dbScanUnlock(record_);
+        group_ = nullptr;
+        record_ = nullptr;
+    }
+};
+
+/**
+ * Consecutive channels of the same lock group (or record) are written under a single lock
+ */
+void DataSourceCA::putMany(const Channel *channels, const Data *data, size_t count)
+{
+    RunLock lock;
+    for (size_t i = 0; i < count; ++i) {
+        auto *pctx = static_cast<ContextData *>(channels[i].contextData);
+        /** Channel not connected */
+        if (!pctx)
+            continue;
+
+        lock.acquire(pctx);
+        putLocked(pctx, data[i]);
+    }
+}
+
+/**
+ * Consecutive channels of the same lock group (or record) are read under a single lock,
+ * so they form a coherent snapshot of that lockset
+ */
+void DataSourceCA::getMany(const Channel *channels, Data *data, size_t count)
+{
+    RunLock lock;
+    for (size_t i = 0; i < count; ++i) {
+        auto *pctx = static_cast<ContextData *>(channels[i].contextData);
+        lock.acquire(pctx);
+        getLocked(pctx, data[i]);
+    }
+}
+
+/**
+ * Sort channels by lockset and build one dbLocker per lockset.
+ * Called after dbLockInitRecords(); locksets don't exist yet when connect() runs at initHookAfterInitDevSup
+ */
+void DataSourceCA::group(std::vector<Channel> &channels)
+{
+    std::unordered_map<unsigned long, std::vector<dbCommon *>> recordsByLockset;
+    std::unordered_map<unsigned long, LockGroup *> groupByLockset;
+    std::vector<unsigned long> locksetIds(channels.size());
+
+    for (size_t i = 0; i < channels.size(); ++i) {
+        auto *pctx = static_cast<ContextData *>(channels[i].contextData);
+        locksetIds[i] = dbLockGetLockId(pctx->addr.precord);
+        auto &recs = recordsByLockset[locksetIds[i]];
+        if (std::find(recs.begin(), recs.end(), pctx->addr.precord) == recs.end())
+            recs.push_back(pctx->addr.precord);
+    }
+
+    for (auto &pair : recordsByLockset) {
+        groups_.emplace_back();
+        groups_.back().locker = dbLockerAlloc(pair.second.data(), pair.second.size(), 0);
+        groupByLockset[pair.first] = groups_.back().locker ? &groups_.back() : nullptr;
+    }
+
+    // Stable, so fields keep their configured order within a lockset
+    std::vector<size_t> order(channels.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return locksetIds[a] < locksetIds[b]; });
+
+    std::vector<Channel> sorted;
+    sorted.reserve(channels.size());
+    for (size_t i : order) {
+        sorted.push_back(channels[i]);
+        static_cast<ContextData *>(channels[i].contextData)->group = groupByLockset[locksetIds[i]];
+    }
+    channels.swap(sorted);
+
+    LOG_INFO("pvSave: grouped %zu channels into %zu locksets\n", channels.size(), recordsByLockset.size());
+}
+
+void DataSourceCA::eventCallback(void *userArg, dbChannel *chan, int eventsRemaining, db_field_log *pfl)
+{
+    auto *pctx = static_cast<ContextData *>(userArg);
+    pctx->tracker->markDirty(pctx->index);
+}
+
+bool DataSourceCA::subscribe(const std::vector<Channel> &channels, ChangeTracker &tracker)
+{
+    constexpr const char *funcName = "DataSourceCA::subscribe";
+
+    // One event task is shared by all monitor sets
+    if (!eventCtx_) {
+        eventCtx_ = db_init_events();
+        if (!eventCtx_) {
+            LOG_ERR("%s: db_init_events failed\n", funcName);
+            return false;
+        }
+        if (db_start_events(eventCtx_, "pvSaveEvent", nullptr, nullptr, epicsThreadPriorityLow) != 0) {
+            LOG_ERR("%s: db_start_events failed\n", funcName);
+            db_close_events(eventCtx_);
+            eventCtx_ = nullptr;
+            return false;
+        }
+    }
+
+    tracker.resize(channels.size());
+
+    size_t failed = 0;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        auto *pctx = static_cast<ContextData *>(channels[i].contextData);
+        pctx->tracker = &tracker;
+        pctx->index = i;
+
+        if (!pctx->chan) {
+            pctx->chan = dbChannelCreate(channels[i].channelName.c_str());
+            if (!pctx->chan || dbChannelOpen(pctx->chan) != 0) {
+                LOG_ERR("%s: unable to open channel %s\n", funcName, channels[i].channelName.c_str());
+                if (pctx->chan)
+                    dbChannelDelete(pctx->chan);
+                pctx->chan = nullptr;
+                ++failed;
+                continue;
+            }
+        }
+
+        pctx->sub = db_add_event(eventCtx_, pctx->chan, eventCallback, pctx, DBE_VALUE | DBE_LOG);
+        if (!pctx->sub) {
+            LOG_ERR("%s: db_add_event failed for %s\n", funcName, channels[i].channelName.c_str());
+            ++failed;
+            continue;
+        }
+        db_event_enable(pctx->sub);
+    }
+
+    // Channels without a subscription would silently stop being saved, so make the caller fall back to polling
+    return failed == 0;
+}
+
 DataSource *createDataSourceCA() { return new DataSourceCA(); }
 
 } // namespace pvsave
\ No newline at end of file
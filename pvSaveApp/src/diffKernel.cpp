@@ -0,0 +1,429 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Vectorized comparison of snapshot columns.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <math.h>
+#include <string.h>
+
+#include "diffKernel.h"
+
+// SIMD kernels are compiled with per-function target attributes and picked at runtime,
+// so the library itself still builds for the baseline architecture
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PVSAVE_DIFF_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace pvsave;
+
+namespace
+{
+
+constexpr size_t BLOCK = 64;    // Elements per bitmap word
+
+inline size_t popcount(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    size_t n = 0;
+    for (; v; v &= v - 1)
+        ++n;
+    return n;
+#endif
+}
+
+template<typename T>
+inline T load(const char* p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+/**
+ * Block kernels compare n <= 64 elements and return the changed mask.
+ * SIMD versions always do a full block; the scalar ones also handle the tail
+ */
+using BitwiseBlock = uint64_t (*)(const char* a, const char* b, size_t n);
+using FloatBlock = uint64_t (*)(const float* a, const float* b, const float* db, size_t n);
+using DoubleBlock = uint64_t (*)(const double* a, const double* b, const double* db, size_t n);
+
+struct Kernels {
+    BitwiseBlock bitwise[4];    // 1, 2, 4 and 8 byte elements
+    FloatBlock floats;
+    DoubleBlock doubles;
+};
+
+//-------------------------------------------------------------------------//
+// Scalar
+//-------------------------------------------------------------------------//
+
+template<typename U>
+uint64_t bitwiseScalar(const char* a, const char* b, size_t n)
+{
+    uint64_t m = 0;
+    for (size_t i = 0; i < n; ++i)
+        m |= uint64_t(load<U>(a + i * sizeof(U)) != load<U>(b + i * sizeof(U))) << i;
+    return m;
+}
+
+template<typename T, typename U>
+uint64_t deadbandScalar(const T* a, const T* b, const T* db, size_t n)
+{
+    uint64_t m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const bool differs = load<U>(reinterpret_cast<const char*>(a + i)) != load<U>(reinterpret_cast<const char*>(b + i));
+        m |= uint64_t(differs && !(fabs(a[i] - b[i]) <= db[i])) << i;
+    }
+    return m;
+}
+
+const Kernels s_scalar = {
+    {bitwiseScalar<uint8_t>, bitwiseScalar<uint16_t>, bitwiseScalar<uint32_t>, bitwiseScalar<uint64_t>},
+    deadbandScalar<float, uint32_t>,
+    deadbandScalar<double, uint64_t>,
+};
+
+#if PVSAVE_DIFF_X86
+
+//-------------------------------------------------------------------------//
+// SSE2
+//-------------------------------------------------------------------------//
+
+#define PVSAVE_SSE2 __attribute__((target("sse2")))
+
+#define LOADU(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+
+PVSAVE_SSE2 uint64_t bitwise8SSE2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 4; ++k)
+        eq |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(LOADU(a + k * 16), LOADU(b + k * 16))))) << (k * 16);
+    return ~eq;
+}
+
+PVSAVE_SSE2 uint64_t bitwise16SSE2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 4; ++k) {
+        // Pack the two 16-bit compares down to one byte per element
+        const __m128i lo = _mm_cmpeq_epi16(LOADU(a + k * 32), LOADU(b + k * 32));
+        const __m128i hi = _mm_cmpeq_epi16(LOADU(a + k * 32 + 16), LOADU(b + k * 32 + 16));
+        eq |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)))) << (k * 16);
+    }
+    return ~eq;
+}
+
+PVSAVE_SSE2 uint64_t bitwise32SSE2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 16; ++k)
+        eq |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(LOADU(a + k * 16), LOADU(b + k * 16))))) << (k * 4);
+    return ~eq;
+}
+
+// SSE2 has no 64-bit compare; both halves have to match
+PVSAVE_SSE2 inline __m128i cmpeq64SSE2(__m128i a, __m128i b)
+{
+    const __m128i c = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+PVSAVE_SSE2 uint64_t bitwise64SSE2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 32; ++k)
+        eq |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(cmpeq64SSE2(LOADU(a + k * 16), LOADU(b + k * 16))))) << (k * 2);
+    return ~eq;
+}
+
+PVSAVE_SSE2 uint64_t floatSSE2(const float* a, const float* b, const float* db, size_t)
+{
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    uint64_t same = 0;
+    for (size_t k = 0; k < 16; ++k) {
+        const __m128 va = _mm_loadu_ps(a + k * 4), vb = _mm_loadu_ps(b + k * 4);
+        const __m128 eq = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_castps_si128(va), _mm_castps_si128(vb)));
+        const __m128 within = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(va, vb), abs), _mm_loadu_ps(db + k * 4));
+        same |= uint64_t(_mm_movemask_ps(_mm_or_ps(eq, within))) << (k * 4);
+    }
+    return ~same;
+}
+
+PVSAVE_SSE2 uint64_t doubleSSE2(const double* a, const double* b, const double* db, size_t)
+{
+    const __m128d abs = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+    uint64_t same = 0;
+    for (size_t k = 0; k < 32; ++k) {
+        const __m128d va = _mm_loadu_pd(a + k * 2), vb = _mm_loadu_pd(b + k * 2);
+        const __m128d eq = _mm_castsi128_pd(cmpeq64SSE2(_mm_castpd_si128(va), _mm_castpd_si128(vb)));
+        const __m128d within = _mm_cmple_pd(_mm_and_pd(_mm_sub_pd(va, vb), abs), _mm_loadu_pd(db + k * 2));
+        same |= uint64_t(_mm_movemask_pd(_mm_or_pd(eq, within))) << (k * 2);
+    }
+    return ~same;
+}
+
+#undef LOADU
+
+const Kernels s_sse2 = {
+    {bitwise8SSE2, bitwise16SSE2, bitwise32SSE2, bitwise64SSE2},
+    floatSSE2,
+    doubleSSE2,
+};
+
+//-------------------------------------------------------------------------//
+// AVX2
+//-------------------------------------------------------------------------//
+
+#define PVSAVE_AVX2 __attribute__((target("avx2")))
+
+#define LOADU(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+
+PVSAVE_AVX2 uint64_t bitwise8AVX2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 2; ++k)
+        eq |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(LOADU(a + k * 32), LOADU(b + k * 32))))) << (k * 32);
+    return ~eq;
+}
+
+PVSAVE_AVX2 uint64_t bitwise16AVX2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 2; ++k) {
+        const __m256i lo = _mm256_cmpeq_epi16(LOADU(a + k * 64), LOADU(b + k * 64));
+        const __m256i hi = _mm256_cmpeq_epi16(LOADU(a + k * 64 + 32), LOADU(b + k * 64 + 32));
+        // packs works within 128-bit lanes, put the quadwords back in element order
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        eq |= uint64_t(uint32_t(_mm256_movemask_epi8(packed))) << (k * 32);
+    }
+    return ~eq;
+}
+
+PVSAVE_AVX2 uint64_t bitwise32AVX2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 8; ++k)
+        eq |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(LOADU(a + k * 32), LOADU(b + k * 32))))) << (k * 8);
+    return ~eq;
+}
+
+PVSAVE_AVX2 uint64_t bitwise64AVX2(const char* a, const char* b, size_t)
+{
+    uint64_t eq = 0;
+    for (size_t k = 0; k < 16; ++k)
+        eq |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(LOADU(a + k * 32), LOADU(b + k * 32))))) << (k * 4);
+    return ~eq;
+}
+
+PVSAVE_AVX2 uint64_t floatAVX2(const float* a, const float* b, const float* db, size_t)
+{
+    const __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    uint64_t same = 0;
+    for (size_t k = 0; k < 8; ++k) {
+        const __m256 va = _mm256_loadu_ps(a + k * 8), vb = _mm256_loadu_ps(b + k * 8);
+        const __m256 eq = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_castps_si256(va), _mm256_castps_si256(vb)));
+        const __m256 within = _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(va, vb), abs), _mm256_loadu_ps(db + k * 8), _CMP_LE_OQ);
+        same |= uint64_t(_mm256_movemask_ps(_mm256_or_ps(eq, within))) << (k * 8);
+    }
+    return ~same;
+}
+
+PVSAVE_AVX2 uint64_t doubleAVX2(const double* a, const double* b, const double* db, size_t)
+{
+    const __m256d abs = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+    uint64_t same = 0;
+    for (size_t k = 0; k < 16; ++k) {
+        const __m256d va = _mm256_loadu_pd(a + k * 4), vb = _mm256_loadu_pd(b + k * 4);
+        const __m256d eq = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_castpd_si256(va), _mm256_castpd_si256(vb)));
+        const __m256d within = _mm256_cmp_pd(_mm256_and_pd(_mm256_sub_pd(va, vb), abs), _mm256_loadu_pd(db + k * 4), _CMP_LE_OQ);
+        same |= uint64_t(_mm256_movemask_pd(_mm256_or_pd(eq, within))) << (k * 4);
+    }
+    return ~same;
+}
+
+#undef LOADU
+
+const Kernels s_avx2 = {
+    {bitwise8AVX2, bitwise16AVX2, bitwise32AVX2, bitwise64AVX2},
+    floatAVX2,
+    doubleAVX2,
+};
+
+#endif // PVSAVE_DIFF_X86
+
+bool supported(EDiffKernel kernel)
+{
+    switch (kernel) {
+    case EDiffKernel::Scalar:
+        return true;
+#if PVSAVE_DIFF_X86
+    case EDiffKernel::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case EDiffKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const Kernels* kernelsFor(EDiffKernel kernel)
+{
+    switch (kernel) {
+#if PVSAVE_DIFF_X86
+    case EDiffKernel::SSE2:
+        return &s_sse2;
+    case EDiffKernel::AVX2:
+        return &s_avx2;
+#endif
+    default:
+        return &s_scalar;
+    }
+}
+
+EDiffKernel bestKernel()
+{
+#if PVSAVE_DIFF_X86
+    // Runs from a static initializer, possibly before libgcc has filled in the CPU features
+    __builtin_cpu_init();
+#endif
+    if (supported(EDiffKernel::AVX2))
+        return EDiffKernel::AVX2;
+    if (supported(EDiffKernel::SSE2))
+        return EDiffKernel::SSE2;
+    return EDiffKernel::Scalar;
+}
+
+EDiffKernel s_kernel = bestKernel();
+const Kernels* s_kernels = kernelsFor(s_kernel);
+
+/**
+ * Runs a block kernel over all full blocks, and the scalar one over the tail
+ */
+template<typename Block, typename Tail>
+size_t diffBlocks(Block block, Tail tail, size_t count, uint64_t* bits)
+{
+    size_t changed = 0;
+    size_t w = 0;
+    for (; (w + 1) * BLOCK <= count; ++w) {
+        bits[w] = block(w * BLOCK);
+        changed += popcount(bits[w]);
+    }
+    if (w * BLOCK < count) {
+        bits[w] = tail(w * BLOCK, count - w * BLOCK);
+        changed += popcount(bits[w]);
+    }
+    return changed;
+}
+
+} // namespace
+
+EDiffKernel pvsave::diffKernel()
+{
+    return s_kernel;
+}
+
+const char* pvsave::diffKernelName(EDiffKernel kernel)
+{
+    switch (kernel) {
+    case EDiffKernel::Scalar: return "scalar";
+    case EDiffKernel::SSE2: return "sse2";
+    case EDiffKernel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool pvsave::setDiffKernel(EDiffKernel kernel)
+{
+    if (!supported(kernel))
+        return false;
+    s_kernel = kernel;
+    s_kernels = kernelsFor(kernel);
+    return true;
+}
+
+size_t pvsave::diffBitwise(const void* a, const void* b, size_t elemSize, size_t count, uint64_t* bits)
+{
+    const char* pa = static_cast<const char*>(a);
+    const char* pb = static_cast<const char*>(b);
+
+    size_t width;
+    switch (elemSize) {
+    case 1: width = 0; break;
+    case 2: width = 1; break;
+    case 4: width = 2; break;
+    case 8: width = 3; break;
+    default:
+        // Odd sizes (DbString). Most blocks are unchanged, so check the whole block first
+        {
+            size_t changed = 0;
+            for (size_t w = 0; w * BLOCK < count; ++w) {
+                const size_t first = w * BLOCK, n = count - first < BLOCK ? count - first : BLOCK;
+                uint64_t m = 0;
+                if (memcmp(pa + first * elemSize, pb + first * elemSize, n * elemSize) != 0) {
+                    for (size_t i = 0; i < n; ++i)
+                        m |= uint64_t(memcmp(pa + (first + i) * elemSize, pb + (first + i) * elemSize, elemSize) != 0) << i;
+                }
+                bits[w] = m;
+                changed += popcount(m);
+            }
+            return changed;
+        }
+    }
+
+    const BitwiseBlock block = s_kernels->bitwise[width];
+    const BitwiseBlock tail = s_scalar.bitwise[width];
+    return diffBlocks(
+        [&](size_t first) { return block(pa + first * elemSize, pb + first * elemSize, BLOCK); },
+        [&](size_t first, size_t n) { return tail(pa + first * elemSize, pb + first * elemSize, n); },
+        count, bits);
+}
+
+size_t pvsave::diffDeadband(const float* a, const float* b, const float* deadband, size_t count, uint64_t* bits)
+{
+    if (!deadband)
+        return diffBitwise(a, b, sizeof(float), count, bits);
+
+    // The deadbands are only loaded for blocks with a bitwise change; usually few are
+    const BitwiseBlock bitwise = s_kernels->bitwise[2];
+    const FloatBlock block = s_kernels->floats;
+    return diffBlocks(
+        [&](size_t first) {
+            const char* pa = reinterpret_cast<const char*>(a + first);
+            const char* pb = reinterpret_cast<const char*>(b + first);
+            return bitwise(pa, pb, BLOCK) ? block(a + first, b + first, deadband + first, BLOCK) : 0;
+        },
+        [&](size_t first, size_t n) { return s_scalar.floats(a + first, b + first, deadband + first, n); },
+        count, bits);
+}
+
+size_t pvsave::diffDeadband(const double* a, const double* b, const double* deadband, size_t count, uint64_t* bits)
+{
+    if (!deadband)
+        return diffBitwise(a, b, sizeof(double), count, bits);
+
+    const BitwiseBlock bitwise = s_kernels->bitwise[3];
+    const DoubleBlock block = s_kernels->doubles;
+    return diffBlocks(
+        [&](size_t first) {
+            const char* pa = reinterpret_cast<const char*>(a + first);
+            const char* pb = reinterpret_cast<const char*>(b + first);
+            return bitwise(pa, pb, BLOCK) ? block(a + first, b + first, deadband + first, BLOCK) : 0;
+        },
+        [&](size_t first, size_t n) { return s_scalar.doubles(a + first, b + first, deadband + first, n); },
+        count, bits);
+}
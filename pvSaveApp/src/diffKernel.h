@@ -0,0 +1,74 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Vectorized comparison of snapshot columns.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pvsave
+{
+
+/**
+ * \brief Index of the lowest set bit of a non-zero word. Use to walk the changed bitmaps
+ */
+inline unsigned lowestBit(uint64_t v)
+{
+#if defined(__GNUC__)
+    return unsigned(__builtin_ctzll(v));
+#else
+    unsigned n = 0;
+    for (; !(v & 1); v >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+enum class EDiffKernel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+/**
+ * \brief Returns the kernel set in use. Picked at startup from what the CPU supports
+ */
+EDiffKernel diffKernel();
+
+const char* diffKernelName(EDiffKernel kernel);
+
+/**
+ * \brief Override the kernel set, e.g. to compare implementations
+ * \returns False if the CPU (or the build) doesn't support it
+ */
+bool setDiffKernel(EDiffKernel kernel);
+
+/**
+ * \brief Compare two arrays of count elements of elemSize bytes, bitwise
+ * Bit i of bits (word i / 64) is set if element i differs. Every word covering count is written, so bits needn't be cleared
+ * \returns Number of elements that differ
+ */
+size_t diffBitwise(const void* a, const void* b, size_t elemSize, size_t count, uint64_t* bits);
+
+/**
+ * \brief Like diffBitwise, but elements that differ by no more than deadband[i] count as unchanged
+ * NaNs are never within the deadband, so a value going to or from NaN is always a change
+ * \param deadband Per-element deadbands. nullptr compares bitwise
+ */
+size_t diffDeadband(const float* a, const float* b, const float* deadband, size_t count, uint64_t* bits);
+size_t diffDeadband(const double* a, const double* b, const double* deadband, size_t count, uint64_t* bits);
+
+} // namespace pvsave
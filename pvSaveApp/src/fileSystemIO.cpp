@@ -17,12 +17,16 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "epicsAlgorithm.h"
 #include "epicsAssert.h"
 #include "epicsExport.h"
 #include "epicsStdio.h"
 #include "epicsString.h"
+#include "epicsThread.h"
+#include "epicsThreadPool.h"
 #include "iocsh.h"
 #include "yajl_parse.h"
 #include "errlog.h"
@@ -30,49 +34,96 @@
 #include "pvsave/pvSave.h"
 #include "pvsave/serialize.h"
 
+#include "binaryFormat.h"
 #include "common.h"
+#include "mappedFile.h"
+#include "numberFormat.h"
 
 constexpr int MAX_LINE_LENGTH = 4096;
+constexpr size_t DEFAULT_COMPACT_CYCLES = 100;
+constexpr size_t MIN_PARSE_CHUNK = 1 << 20;   // Text files are only split into chunks of at least this many bytes
+
+static int s_parseThreads = 1;  // Threads for parsing a large text file, > 1 splits it into chunks parsed in parallel
 
 namespace pvsave {
 
-enum fileSystemIOType { FSIO_TYPE_TEXT, FSIO_TYPE_JSON };
+enum fileSystemIOType { FSIO_TYPE_TEXT, FSIO_TYPE_JSON, FSIO_TYPE_BINARY, FSIO_TYPE_JOURNAL };
 
 /**
  * \brief Implementation of the file system IO backend
- * Supports an autosave-like text format and JSON parsed using yajl
+ * Supports an autosave-like text format, JSON parsed using yajl, a binary format and a binary journal (see binaryFormat.h).
+ * In journal mode each save appends only the changed channels, and a full snapshot replaces the journal every
+ * compactCycles saves or once the journal has grown to compactBytes
  */
 class fileSystemIO : public pvsave::SaveRestoreIO {
 public:
-    fileSystemIO(const char *name, const char *filePath, fileSystemIOType type)
-        : pvsave::SaveRestoreIO(name), type_(type), path_(filePath) {}
-
-    uint32_t flags() const override { return Write | Read; /* Both read and write supported */ }
+    fileSystemIO(const char *name, const char *filePath, fileSystemIOType type, size_t compactCycles = 0, size_t compactBytes = 0)
+        : pvsave::SaveRestoreIO(name), type_(type), path_(filePath),
+          compactCycles_(compactCycles ? compactCycles : DEFAULT_COMPACT_CYCLES), compactBytes_(compactBytes) {}
+
+    /**
+     * \brief One file of a shardedFileSystemIO. Not listed in ioBackends()
+     */
+    fileSystemIO(const char *name, const char *filePath, fileSystemIOType type, Unlisted)
+        : pvsave::SaveRestoreIO(name, Unlisted()), type_(type), path_(filePath),
+          compactCycles_(DEFAULT_COMPACT_CYCLES), compactBytes_(0) {}
+
+    uint32_t flags() const override {
+        /* Both read and write supported */
+        return Write | Read | (type_ == FSIO_TYPE_JOURNAL ? Delta : 0);
+    }
 
     bool openFile();
 
     bool beginWrite() override;
-    bool beginWriteJson();
+    bool beginDelta() override;
+    void beginWriteJson();
     bool saveText(const DataSource::Channel &channel, const Data &data);
     bool saveJson(const DataSource::Channel &channel, const Data &data);
     bool writeData(const DataSource::Channel &channel, const Data& pvValue) override;
     void endWriteJson();
+    bool endWriteBinary();
     bool endWrite() override;
+    bool writeOut(struct iovec* iov, int count);
 
     /** Reading interface */
     bool beginRead() override { return openFile(); }
-    bool readText(std::unordered_map<std::string, Data>& pvs);
-    bool readJson(std::unordered_map<std::string, Data>& pvs);
+    bool readText(const char* data, size_t size, RestoreSink& sink);
+    bool readTextParallel(const char* data, size_t size, size_t threads, RestoreSink& sink);
+    template<typename Emit>
+    void parseText(const char* file, const char* begin, const char* end, int firstLine, Emit&& emit) const;
+    bool readJson(const char* data, size_t size, RestoreSink& sink);
     bool readData(std::unordered_map<std::string, Data>& pvs) override;
+    bool readStream(RestoreSink& sink) override;
     bool endRead() override { return true; }
 
     void report(FILE* fp, int indent) override;
 
 protected:
+    struct TextChunk;
+
     fileSystemIOType type_;
     std::string path_;
     size_t currentChan_;        // Hack for JSON trailing commas
+    std::string out_;           // Text or JSON file being built, written out in one go by endWrite(). Reused between writes
+    BinaryWriter binary_;       // Binary file being built, written out in one go by endWrite()
     FILE *handle_ = nullptr;
+
+    // Write stats
+    size_t lastBytes_ = 0;
+    size_t lastSyscalls_ = 0;
+    size_t totalBytes_ = 0;
+    size_t totalSyscalls_ = 0;
+    size_t writes_ = 0;
+
+    // Journal mode
+    size_t compactCycles_;
+    size_t compactBytes_;       // 0 compacts once the journal is as large as the snapshot
+    bool delta_ = false;        // Current write appends to the journal
+    size_t snapshotBytes_ = 0;  // Size of the snapshot at the start of the file, 0 if it hasn't been written yet
+    size_t cycle_ = 0;          // Journal records after the snapshot
+    size_t journalBytes_ = 0;   // Size of those records
+    size_t compactions_ = 0;
 };
 
 bool fileSystemIO::beginWrite() {
@@ -91,15 +142,88 @@ bool fileSystemIO::beginWrite() {
         return false;
     }
         
+    delta_ = false;
+    lastBytes_ = lastSyscalls_ = 0;
+    out_.clear();
     if (type_ == FSIO_TYPE_JSON)
-        return beginWriteJson();
+        beginWriteJson();
+    if (type_ == FSIO_TYPE_BINARY || type_ == FSIO_TYPE_JOURNAL)
+        binary_.clear();
+    return true;
+}
+
+/**
+ * Append a journal record, unless it's time to compact the journal into a new snapshot
+ */
+bool fileSystemIO::beginDelta() {
+    if (type_ != FSIO_TYPE_JOURNAL || !snapshotBytes_ || cycle_ >= compactCycles_
+        || journalBytes_ >= (compactBytes_ ? compactBytes_ : snapshotBytes_))
+        return false;
+
+    // The file is opened in append mode, so records always go to the end
+    if (!openFile())
+        return false;
+
+    binary_.clear();
+    delta_ = true;
+    lastBytes_ = lastSyscalls_ = 0;
     return true;
 }
 
+/**
+ * Write out everything the transaction produced. Nothing is written to the file before this
+ */
 bool fileSystemIO::endWrite() {
-    if (type_ == FSIO_TYPE_JSON)
-        endWriteJson();
-    fflush(handle_);
+    bool ok;
+    if (type_ == FSIO_TYPE_BINARY || type_ == FSIO_TYPE_JOURNAL) {
+        ok = endWriteBinary();
+        // Whatever made it into the file can't be appended to
+        if (!ok)
+            snapshotBytes_ = 0;
+    }
+    else {
+        if (type_ == FSIO_TYPE_JSON)
+            endWriteJson();
+        struct iovec iov = {&out_[0], out_.size()};
+        ok = writeOut(&iov, 1);
+    }
+
+    ++writes_;
+    totalBytes_ += lastBytes_;
+    totalSyscalls_ += lastSyscalls_;
+    return ok;
+}
+
+/**
+ * \brief Write buffers to the end of the file. Takes a single writev unless the kernel accepts less than everything
+ */
+bool fileSystemIO::writeOut(struct iovec* iov, int count) {
+    const char *funcName = "fileSystemIO::writeOut";
+    const int fd = fileno(handle_);
+
+    while (count > 0) {
+        const ssize_t n = ::writev(fd, iov, count);
+        ++lastSyscalls_;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERR("%s: writev to %s failed: %s\n", funcName, path_.c_str(), strerror(errno));
+            return false;
+        }
+        lastBytes_ += size_t(n);
+
+        // Skip past what was written
+        size_t done = size_t(n);
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
     return true;
 }
 
@@ -117,19 +241,31 @@ bool fileSystemIO::openFile() {
 }
 
 /**
- * Read data off disk
+ * Read data off disk. The file is mapped and parsed in place
  */
-bool fileSystemIO::readData(std::unordered_map<std::string, Data>& pvs) {
-    const char *funcName = "fileSystemIO::readData";
-    if (fseek(handle_, 0, SEEK_SET) != 0) {
-        printf("%s: fseek failed: %s\n", funcName, strerror(errno));
+bool fileSystemIO::readStream(RestoreSink& sink) {
+    const char *funcName = "fileSystemIO::readStream";
+
+    MappedFile file;
+    if (!file.open(path_.c_str())) {
+        LOG_ERR("%s: unable to map %s: %s\n", funcName, path_.c_str(), strerror(errno));
+        return false;
     }
 
     switch (type_) {
     case FSIO_TYPE_TEXT:
-        return readText(pvs);
-    case FSIO_TYPE_JSON: /** TODO: implement me! */
-        return readJson(pvs);
+        return readText(file.data(), file.size(), sink);
+    case FSIO_TYPE_JSON:
+        return readJson(file.data(), file.size(), sink);
+    case FSIO_TYPE_BINARY:
+        // Nothing saved yet
+        if (!file.size())
+            return true;
+        return pvsave::readBinary(file.data(), file.size(), sink, path_.c_str());
+    case FSIO_TYPE_JOURNAL:
+        if (!file.size())
+            return true;
+        return pvsave::readJournal(file.data(), file.size(), sink, path_.c_str());
     default:
         break;
     }
@@ -137,22 +273,45 @@ bool fileSystemIO::readData(std::unordered_map<std::string, Data>& pvs) {
     return false;
 }
 
+/**
+ * Collects streamed channel data into a map, for readData(). The reverse of SaveRestoreIO::readStream()
+ */
+class MapSink : public RestoreSink {
+public:
+    MapSink(std::unordered_map<std::string, Data>& pvs) : pvs_(pvs) {}
+    void onData(const char* name, size_t nameLen, const Data& value) override {
+        pvs_[std::string(name, nameLen)] = value;
+    }
+    std::unordered_map<std::string, Data>& pvs_;
+};
+
+/**
+ * Read data off disk into a map. Only kept for callers that need random access to the whole file
+ * Journals can hold a channel more than once, the last value wins
+ */
+bool fileSystemIO::readData(std::unordered_map<std::string, Data>& pvs) {
+    MapSink sink(pvs);
+    return readStream(sink);
+}
+
 /**
  * \brief Save implementation of autosave-like .SAV files
  */
 bool fileSystemIO::saveText(const DataSource::Channel& channel, const Data &value) {
-    const char *funcName = "fileSystemIO::saveText";
-
-    // PV name
-    if (fputs(channel.channelName.c_str(), handle_) < 0) {
-        LOG_ERR("%s: fputs failed: %s\n", funcName, strerror(errno));
-        return false;
+    // PV name and type
+    out_.append(channel.channelName);
+    out_.push_back(' ');
+    out_.append(pvsave::dataTypeString(value));
+    out_.push_back(' ');
+
+    // Arrays can be much larger than a line, they're formatted straight into the buffer
+    if (auto* arr = value.get<DataArray>()) {
+        if (!arrayToString(*arr, out_)) {
+            LOG_ERR("Unable to serialize %s\n", channel.channelName.c_str());
+        }
+        out_.push_back('\n');
+        return true;
     }
-    fputc(' ', handle_);
-
-    // Type string
-    fputs(pvsave::typeCodeString(value.type_code()), handle_);
-    fputc(' ', handle_);
 
     // Value
     char line[MAX_LINE_LENGTH];
@@ -161,8 +320,8 @@ bool fileSystemIO::saveText(const DataSource::Channel& channel, const Data &valu
         LOG_ERR("Unable to serialize %s\n", channel.channelName.c_str());
     }
 
-    fputs(line, handle_);
-    fputc('\n', handle_);
+    out_.append(line);
+    out_.push_back('\n');
     return true;
 }
 
@@ -170,19 +329,22 @@ bool fileSystemIO::saveText(const DataSource::Channel& channel, const Data &valu
  * \brief Save implementation for JSON
  */
 bool fileSystemIO::saveJson(const DataSource::Channel &channel, const Data &value) {
-    const char *funcName = "fileSystemIO::saveJson";
-    
     // Hack for json trailing commas. Need to finish off previous line, if any
-    if (currentChan_ > 0)
-        fputs(",\n", handle_);
-    else
-        fputs("\n", handle_);
-    pindent(handle_, 1);
+    out_.append(currentChan_ > 0 ? ",\n \"" : "\n \"");
 
     // PV name and type
-    if (fprintf(handle_, "\"%s#%s\": ", channel.channelName.c_str(), pvsave::typeCodeString(value.type_code())) < 0) {
-        LOG_ERR("%s: fputs failed: %s\n", funcName, strerror(errno));
-        return false;
+    out_.append(channel.channelName);
+    out_.push_back('#');
+    out_.append(pvsave::dataTypeString(value));
+    out_.append("\": \"");
+
+    if (auto* arr = value.get<DataArray>()) {
+        if (!arrayToString(*arr, out_)) {
+            LOG_ERR("Unable to serialize %s\n", channel.channelName.c_str());
+        }
+        out_.push_back('"');
+        currentChan_++;
+        return true;
     }
 
     // Value
@@ -192,22 +354,19 @@ bool fileSystemIO::saveJson(const DataSource::Channel &channel, const Data &valu
         LOG_ERR("Unable to serialize %s\n", channel.channelName.c_str());
     }
 
-    if (fprintf(handle_, "\"%s\"", line) < 0) {
-        LOG_ERR("%s: fprintf failed: %s\n", funcName, strerror(errno));
-    }
+    out_.append(line);
+    out_.push_back('"');
 
-    fflush(handle_);
-    
     currentChan_++;
     return true;
 }
 
-bool fileSystemIO::beginWriteJson() {
-    return fputs("{\n", handle_) >= 0;
+void fileSystemIO::beginWriteJson() {
+    out_.append("{\n");
 }
 
 void fileSystemIO::endWriteJson() {
-    fputs("\n}\n", handle_);
+    out_.append("\n}\n");
 }
 
 /**
@@ -219,19 +378,66 @@ bool fileSystemIO::writeData(const DataSource::Channel &channel, const Data &val
         return saveText(channel, value);
     case FSIO_TYPE_JSON:
         return saveJson(channel, value);
+    case FSIO_TYPE_BINARY:
+    case FSIO_TYPE_JOURNAL:
+        if (!binary_.add(channel.channelName, value))
+            LOG_ERR("Unable to serialize %s\n", channel.channelName.c_str());
+        return true;
     default:
         break;
     }
     return false;
 }
 
+/**
+ * \brief Lay out the binary file and write it with a single writev
+ * Journal records are preceded by their JournalRecord header
+ */
+bool fileSystemIO::endWriteBinary() {
+    const std::string& file = binary_.finish();
+
+    JournalRecord record;
+    struct iovec iov[2];
+    int count = 0;
+    if (delta_) {
+        memcpy(record.magic, JOURNAL_MAGIC, sizeof(record.magic));
+        record.bytes = uint32_t(file.size());
+        record.cycle = cycle_ + 1;
+        iov[count++] = {&record, sizeof(record)};
+    }
+    iov[count++] = {const_cast<char*>(file.data()), file.size()};
+
+    if (!writeOut(iov, count))
+        return false;
+
+    if (delta_) {
+        ++cycle_;
+        journalBytes_ += sizeof(JournalRecord) + file.size();
+    }
+    else if (type_ == FSIO_TYPE_JOURNAL) {
+        snapshotBytes_ = file.size();
+        cycle_ = 0;
+        journalBytes_ = 0;
+        ++compactions_;
+    }
+    return true;
+}
+
 /**
  * \brief Implementation of JSON reading using yajl
+ * The whole file is handed to yajl at once. Keys and values are parsed where they lie in the file, and each channel is
+ * resolved against the sink as soon as its key is seen, so values of channels the sink doesn't want are never parsed.
+ * Only strings with escapes reach the callbacks from yajl's own buffer; that buffer is reused for the value, so such keys
+ * are copied first. yajl reassembles tokens split across yajl_parse() calls, so none ever straddle a callback
  */
-bool fileSystemIO::readJson(std::unordered_map<std::string, Data>& pvs) {
+bool fileSystemIO::readJson(const char* data, size_t size, RestoreSink& sink) {
     static const char* funcName = "fileSystemIO::readJson";
     bool success = true;
 
+    // Nothing saved yet
+    if (!size)
+        return true;
+
     yajl_alloc_funcs af = {
         .malloc = [](void* c, size_t s) { return malloc(s); },
         .realloc = [](void* c, void* p, size_t s) { return realloc(p, s); },
@@ -239,51 +445,78 @@ bool fileSystemIO::readJson(std::unordered_map<std::string, Data>& pvs) {
     };
 
     struct JsonReadState {
-        std::unordered_map<std::string, Data>& pvs;
+        RestoreSink& sink;
+        const char* begin;      // The file, keys within it are used in place
+        const char* end;
         ETypeCode type;
-        std::string curPv;
+        bool array;
+        const char* pv;         // Name of the current PV, without the type suffix
+        size_t pvLen;
+        size_t channel;         // Handle from RestoreSink::resolve() for the current PV
+        std::string keyBuf;     // Keys with escapes are decoded by yajl into a buffer that the value reuses, those are copied here
+        Data value;             // Reused for every value
         bool skip;
-    } jsonReadState {pvs};
+    } jsonReadState {sink, data, data + size};
 
     yajl_callbacks cb = {
         .yajl_string = [](void* c, const unsigned char* value, size_t l) -> int {
             auto pc = static_cast<JsonReadState*>(c);
             if (!pc->skip) {
-                auto* pstr = const_cast<unsigned char*>(value);
-                // FIXME: SUCKS!! avoid copy, directly modify string...
-                auto c = *(pstr + l);
-                *(pstr + l) = 0;
-                auto result = dataParseString((const char*)pstr, pc->type);
-                *(pstr + l) = c;
-                if (!result.first) {
-                    LOG_ERR("%s: Unable to parse data for %s\n", funcName, pc->curPv.c_str());
+                const char* pstr = reinterpret_cast<const char*>(value);
+                bool ok;
+                if (pc->array) {
+                    if (!pc->value.is<DataArray>())
+                        pc->value.construct<DataArray>();
+                    ok = arrayFromView(pstr, l, pc->type, *pc->value.get<DataArray>());
+                }
+                else
+                    ok = dataParseView(pstr, l, pc->type, pc->value);
+
+                if (!ok) {
+                    LOG_ERR("%s: Unable to parse data for %.*s\n", funcName, int(pc->pvLen), pc->pv);
                 }
                 else {
-                    pc->pvs.insert({pc->curPv, result.second});
+                    pc->sink.onResolved(pc->channel, pc->pv, pc->pvLen, pc->value);
                 }
             }
             return 1;
         },
         .yajl_map_key = [](void* c, const unsigned char* key, size_t l) -> int {
             auto pc = static_cast<JsonReadState*>(c);
-            pc->curPv.assign((const char*)key, l);
+            const char* pkey = reinterpret_cast<const char*>(key);
+            if (pkey < pc->begin || pkey >= pc->end) {
+                pc->keyBuf.assign(pkey, l);
+                pkey = pc->keyBuf.data();
+            }
             pc->skip = false;
             // Types are specified in the PV name, denoted by a # prefix. i.e. myCool:PV:Or:Something#uint32_t
             // this could probably be implemented better, but this is the cheapest way to do it
-            auto sep = pc->curPv.find_last_of('#');
-            if (sep == pc->curPv.npos) {
-                LOG_ERR("%s: Missing typecode for PV '%s'\n", funcName, key);
+            size_t sep = l;
+            while (sep > 0 && pkey[sep - 1] != '#')
+                --sep;
+            if (sep == 0) {
+                LOG_ERR("%s: Missing typecode for PV '%.*s'\n", funcName, int(l), pkey);
                 pc->skip = true; // Skip if errored
             }
             else {
-                pc->curPv.erase(sep);
-                auto tc = pvsave::typeCodeFromString(pc->curPv.c_str()+sep+1);
+                const char* ptype = pkey + sep;
+                const size_t typeLen = l - sep;
+                auto tc = pvsave::typeCodeFromView(ptype, typeLen);
+                pc->array = false;
+                if (!tc.first && (tc = pvsave::arrayTypeCodeFromView(ptype, typeLen)).first)
+                    pc->array = true;
                 if (!tc.first) {
-                    LOG_ERR("%s: Unknown type code %s\n", funcName, pc->curPv.c_str()+sep+1);
+                    LOG_ERR("%s: Unknown type code %.*s\n", funcName, int(typeLen), ptype);
                     pc->skip = true; // Skip if errored
                 }
                 else
                     pc->type = tc.second;
+                pc->pv = pkey;
+                pc->pvLen = sep - 1;
+                if (!pc->skip) {
+                    pc->channel = pc->sink.resolve(pc->pv, pc->pvLen);
+                    pc->skip = pc->channel == RestoreSink::UNKNOWN;
+                }
             }
             return 1;
         }
@@ -295,102 +528,243 @@ bool fileSystemIO::readJson(std::unordered_map<std::string, Data>& pvs) {
         return false;
     }
 
-    // Alloc a working buffer in the heap (keep stack usage low!)
-    size_t bs = 16384, nread = 0;
-    unsigned char* rb = (unsigned char*)malloc(bs);
-    while ((nread = fread(rb, 1, bs, handle_)) > 0) {
-        if (yajl_parse(yh, rb, nread) != yajl_status_ok) {
-            auto* errstr = yajl_get_error(yh, 1, rb, nread);
-            LOG_ERR("%s: yajl_parse returned error: %s\n", funcName, errstr);
-            free(errstr);
-            success = false;
-            goto done;
-        }
+    if (yajl_parse(yh, reinterpret_cast<const unsigned char*>(data), size) != yajl_status_ok
+        || yajl_complete_parse(yh) != yajl_status_ok) {
+        auto* errstr = yajl_get_error(yh, 1, reinterpret_cast<const unsigned char*>(data), size);
+        LOG_ERR("%s: yajl_parse returned error: %s\n", funcName, errstr);
+        yajl_free_error(yh, errstr);
+        success = false;
     }
 
-    // Flush out any remaining bytes
-    yajl_complete_parse(yh);
-done:
     yajl_free(yh);
-    free(rb);
     return success;
 }
 
 /**
- * Implementation of autosave-like text format for SAV files
+ * Returns the next space delimited token of a line, and advances p past it. Returns nullptr at the end of the line
  */
-bool fileSystemIO::readText(std::unordered_map<std::string, Data> &pvs) {
-    const char *funcName = "fileSystemIO::readText";
-
-    const size_t bl = 16384;
-    char *buf = (char *)malloc(bl);
+static const char* nextToken(const char*& p, const char* end, size_t& len) {
+    while (p < end && *p == ' ')
+        ++p;
+    if (p == end)
+        return nullptr;
+    const char* token = p;
+    while (p < end && *p != ' ')
+        ++p;
+    len = p - token;
+    return token;
+}
 
-    char *lptr = nullptr;
-    size_t len = 0;
+/**
+ * Returns the line number of p within the file. Chunks that don't know where they start look it up on their first error
+ */
+static int lineOf(const char* file, const char* p) {
+    int line = 1;
+    while ((file = static_cast<const char*>(memchr(file, '\n', p - file))))
+        ++line, ++file;
+    return line;
+}
 
-    int line;
-    for (lptr = fgets(buf, bl, handle_), line = 1; lptr != nullptr;
-         lptr = nullptr, lptr = fgets(buf, bl, handle_), ++line) {
+/**
+ * Parses the lines of an autosave-like text file in [begin, end), which must start at the beginning of a line
+ * Lines are tokenized in place; names, types and values are passed to the parsers as views into the file.
+ * emit(name, nameLen, value) is called for every valid line. It may move from value
+ * \param file Start of the whole file
+ * \param firstLine Line number of begin, or 0 if unknown. Only used for error messages
+ */
+template<typename Emit>
+void fileSystemIO::parseText(const char* file, const char* begin, const char* end, int firstLine, Emit&& emit) const {
+    const char *funcName = "fileSystemIO::readText";
 
-        len = strlen(lptr); // len is not actually string length, it's buffer length
+    const char* p = begin;
+    Data value;                 // Reused for every value
+    std::string unescaped;      // Only used for values with quotes or escapes
 
-        // Strip off delimeter
-        if (len > 0)
-            lptr[--len] = 0;
+    for (int line = 0; p < end; ++line) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        const char* lp = p;
+        p = eol < end ? eol + 1 : end;
 
         // Skip empty lines
-        if (!len)
+        if (lp == eol)
             continue;
 
-        char *sp = nullptr, *pname = nullptr, *ptype = nullptr, *pval = nullptr;
+        auto lineNo = [&] {
+            if (!firstLine)
+                firstLine = lineOf(file, begin);
+            return firstLine + line;
+        };
+        size_t nameLen = 0, typeLen = 0, valLen = 0;
 
         // PV name
-        pname = strtok_r(lptr, " ", &sp);
+        const char* pname = nextToken(lp, eol, nameLen);
         if (!pname) {
-            LOG_ERR("%s: file %s, line %d: missing PV name\n", funcName, path_.c_str(), line);
+            LOG_ERR("%s: file %s, line %d: missing PV name\n", funcName, path_.c_str(), lineNo());
             continue;
         }
 
         // PV type
-        ptype = strtok_r(nullptr, " ", &sp);
+        const char* ptype = nextToken(lp, eol, typeLen);
         if (!ptype) {
-            LOG_ERR("%s: file %s, line %d: missing PV type\n", funcName, path_.c_str(), line);
+            LOG_ERR("%s: file %s, line %d: missing PV type\n", funcName, path_.c_str(), lineNo());
             continue;
         }
 
         // PV value
-        pval = strtok_r(nullptr, " ", &sp);
+        const char* pval = nextToken(lp, eol, valLen);
         if (!pval) {
-            LOG_ERR("%s: file %s, line %d: missing PV value\n", funcName, path_.c_str(), line);
+            LOG_ERR("%s: file %s, line %d: missing PV value\n", funcName, path_.c_str(), lineNo());
             continue;
         }
 
         // Determine and validate type
-        auto typeCode = pvsave::typeCodeFromString(ptype);
+        auto typeCode = pvsave::typeCodeFromView(ptype, typeLen);
         if (!typeCode.first) {
-            LOG_ERR("%s: file %s, line %d: unknown type name '%s'\n", funcName, path_.c_str(), line, ptype);
+            // Arrays are written without quotes or escapes, so they can be parsed in place
+            auto elemType = pvsave::arrayTypeCodeFromView(ptype, typeLen);
+            if (!elemType.first) {
+                LOG_ERR("%s: file %s, line %d: unknown type name '%.*s'\n", funcName, path_.c_str(), lineNo(), int(typeLen), ptype);
+                continue;
+            }
+            if (!value.is<DataArray>())
+                value.construct<DataArray>();
+            if (!pvsave::arrayFromView(pval, valLen, elemType.second, *value.get<DataArray>())) {
+                LOG_ERR("%s: file %s, line %d: unable to parse array value\n", funcName, path_.c_str(), lineNo());
+                continue;
+            }
+            emit(pname, nameLen, value);
             continue;
         }
 
-        std::string parsedValue;
-        if (pvsave::parseString(pval, parsedValue) == pval) {
-            LOG_ERR("%s: file %s, line %d: failed to parse value string\n", funcName, path_.c_str(), line);
-            continue;
+        // Quoted or escaped strings need unescaping, which is the only case that copies the value
+        if (*pval == '"' || memchr(pval, '\\', valLen)) {
+            unescaped.assign(pval, valLen);
+            std::string parsedValue;
+            if (pvsave::parseString(unescaped.c_str(), parsedValue) == unescaped.c_str()) {
+                LOG_ERR("%s: file %s, line %d: failed to parse value string\n", funcName, path_.c_str(), lineNo());
+                continue;
+            }
+            unescaped.swap(parsedValue);
+            pval = unescaped.c_str();
+            valLen = unescaped.size();
         }
 
         // Parse the data into a variant
-        auto value = pvsave::dataParseString(parsedValue.c_str(), typeCode.second);
-        if (!value.first) {
-            LOG_ERR("%s: file %s, line %d: unable to parse value '%s'\n", funcName, path_.c_str(), line, pval);
+        if (!pvsave::dataParseView(pval, valLen, typeCode.second, value)) {
+            LOG_ERR("%s: file %s, line %d: unable to parse value '%.*s'\n", funcName, path_.c_str(), lineNo(), int(valLen), pval);
             continue;
         }
 
-        pvs.insert({pname, value.second});
+        emit(pname, nameLen, value);
     }
+}
 
-    if (!lptr && errno != 0 && errno != EOF) {
-        LOG_ERR("%s: getline failed: %s\n", funcName, strerror(errno));
-        return false;
+/**
+ * Implementation of autosave-like text format for SAV files
+ * Large files are split into chunks and parsed in parallel when pvSave_SetTextParseThreads allows it
+ */
+bool fileSystemIO::readText(const char* data, size_t size, RestoreSink& sink) {
+    const size_t threads = epicsMin(size_t(epicsMax(s_parseThreads, 1)), size / MIN_PARSE_CHUNK);
+    if (threads > 1)
+        return readTextParallel(data, size, threads, sink);
+
+    parseText(data, data, data + size, 1, [&](const char* name, size_t nameLen, Data& value) {
+        sink.onData(name, nameLen, value);
+    });
+    return true;
+}
+
+/**
+ * One chunk of a text file parsed by readTextParallel(). Names in entries point into the file
+ */
+struct fileSystemIO::TextChunk {
+    struct Entry {
+        const char* name;
+        size_t nameLen;
+        Data value;
+    };
+
+    const fileSystemIO* io;
+    const char* file;
+    const char* begin;
+    const char* end;
+    std::vector<Entry> entries;
+
+    void parse() {
+        // Roughly one entry per 40 bytes of a typical save file
+        entries.reserve((end - begin) / 40);
+        io->parseText(file, begin, end, file == begin ? 1 : 0, [this](const char* name, size_t nameLen, Data& value) {
+            entries.push_back({name, nameLen, std::move(value)});
+        });
+    }
+
+    static void jobFunc(void* arg, epicsJobMode mode) {
+        if (mode == epicsJobModeRun)
+            static_cast<TextChunk*>(arg)->parse();
+    }
+};
+
+/**
+ * Split the file at line boundaries into one chunk per thread and parse them on a thread pool, the first one on this thread.
+ * The sink isn't thread safe, so every chunk keeps what it parsed and the results are handed over afterwards, in file order
+ */
+bool fileSystemIO::readTextParallel(const char* data, size_t size, size_t threads, RestoreSink& sink) {
+    const char* const fileEnd = data + size;
+    std::vector<TextChunk> chunks;
+    chunks.reserve(threads);
+    const char* begin = data;
+    for (size_t i = 1; i <= threads && begin < fileEnd; ++i) {
+        const char* end = i == threads ? fileEnd : data + size / threads * i;
+        if (end <= begin)
+            end = begin;
+        if (end < fileEnd) {
+            end = static_cast<const char*>(memchr(end, '\n', fileEnd - end));
+            end = end ? end + 1 : fileEnd;
+        }
+        chunks.push_back({this, data, begin, end, {}});
+        begin = end;
+    }
+
+    epicsThreadPoolConfig conf;
+    epicsThreadPoolConfigDefaults(&conf);
+    conf.maxThreads = chunks.size() - 1;
+    conf.initialThreads = conf.maxThreads;
+    conf.workerStack = epicsThreadGetStackSize(epicsThreadStackMedium);
+    epicsThreadPool* pool = chunks.size() > 1 ? epicsThreadPoolCreate(&conf) : nullptr;
+    if (chunks.size() > 1 && !pool)
+        LOG_WARN("fileSystemIO::readText: unable to create parse thread pool, parsing %s serially\n", path_.c_str());
+
+    std::vector<epicsJob*> jobs(chunks.size(), nullptr);
+    for (size_t i = 1; pool && i < chunks.size(); ++i) {
+        jobs[i] = epicsJobCreate(pool, TextChunk::jobFunc, &chunks[i]);
+        if (jobs[i] && epicsJobQueue(jobs[i]) != 0) {
+            epicsJobDestroy(jobs[i]);
+            jobs[i] = nullptr;
+        }
+    }
+
+    // Anything that couldn't be queued is parsed here
+    chunks[0].parse();
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        if (!jobs[i])
+            chunks[i].parse();
+    }
+
+    if (pool) {
+        epicsThreadPoolWait(pool, -1);
+        for (auto* job : jobs) {
+            if (job)
+                epicsJobDestroy(job);
+        }
+        epicsThreadPoolDestroy(pool);
+    }
+
+    for (auto& chunk : chunks) {
+        for (auto& entry : chunk.entries)
+            sink.onData(entry.name, entry.nameLen, entry.value);
+        std::vector<TextChunk::Entry>().swap(chunk.entries);
     }
     return true;
 }
@@ -408,37 +782,417 @@ void fileSystemIO::report(FILE* fp, int indent) {
         fprintf(fp, "json\n"); break;
     case FSIO_TYPE_TEXT:
         fprintf(fp, "text\n"); break;
+    case FSIO_TYPE_BINARY:
+        fprintf(fp, "binary\n"); break;
+    case FSIO_TYPE_JOURNAL:
+        fprintf(fp, "journal\n"); break;
     default:
         break;
     }
+    if (type_ == FSIO_TYPE_JOURNAL) {
+        pvsave::pindent(fp, indent);
+        fprintf(fp, "journal: %zu cycles, %zu bytes after a %zu byte snapshot, %zu snapshots written\n",
+            cycle_, journalBytes_, snapshotBytes_, compactions_);
+        pvsave::pindent(fp, indent);
+        if (compactBytes_)
+            fprintf(fp, "compact: every %zu cycles or %zu bytes\n", compactCycles_, compactBytes_);
+        else
+            fprintf(fp, "compact: every %zu cycles or once the journal outgrows the snapshot\n", compactCycles_);
+    }
     pvsave::pindent(fp, indent);
     fprintf(fp, "flags: %s%s\n", (flags() & Read) ? "r" : "", (flags() & Write) ? "w" : "");
     pvsave::pindent(fp, indent);
     fprintf(fp, "file: %s\n", path_.c_str());
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "last write: %zu bytes in %zu syscalls\n", lastBytes_, lastSyscalls_);
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "total: %zu writes, %zu bytes in %zu syscalls\n", writes_, totalBytes_, totalSyscalls_);
+}
+
+/**
+ * \brief Calls fn on every item, the first on this thread and the rest as jobs on pool
+ * Items that can't be queued, or all of them if there is no pool, are handled on this thread. Returns once all are done
+ */
+template<typename T>
+static void runOnPool(epicsThreadPool* pool, std::vector<T>& items, void (*fn)(T&)) {
+    struct Job {
+        T* item;
+        void (*fn)(T&);
+        epicsJob* handle;
+    };
+    std::vector<Job> jobs(items.size(), Job{nullptr, fn, nullptr});
+    for (size_t i = 1; pool && i < items.size(); ++i) {
+        jobs[i].item = &items[i];
+        jobs[i].handle = epicsJobCreate(pool, [](void* arg, epicsJobMode mode) {
+            auto* job = static_cast<Job*>(arg);
+            if (mode == epicsJobModeRun)
+                job->fn(*job->item);
+        }, &jobs[i]);
+        if (jobs[i].handle && epicsJobQueue(jobs[i].handle) != 0) {
+            epicsJobDestroy(jobs[i].handle);
+            jobs[i].handle = nullptr;
+        }
+    }
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (!jobs[i].handle)
+            fn(items[i]);
+    }
+
+    if (pool)
+        epicsThreadPoolWait(pool, -1);
+    for (auto& job : jobs) {
+        if (job.handle)
+            epicsJobDestroy(job.handle);
+    }
+}
+
+/**
+ * \brief File system backend that partitions a set's channels across several files
+ * Channels are dealt out round robin to files named after filePath with the shard number before the extension
+ * (name.sav -> name.0.sav, name.1.sav, ...), each in the configured format. Shards are written and read in parallel,
+ * one thread each, which helps on file systems that limit per-file rather than aggregate throughput.
+ * filePath itself holds a manifest listing the shards, so a restore reads whatever layout was last saved, even if
+ * the shard count has been changed since. Journal mode isn't supported
+ */
+class shardedFileSystemIO : public pvsave::SaveRestoreIO {
+public:
+    shardedFileSystemIO(const char *name, const char *filePath, fileSystemIOType type, size_t shards);
+    ~shardedFileSystemIO();
+
+    uint32_t flags() const override { return Write | Read; }
+
+    bool beginWrite() override;
+    bool writeData(const DataSource::Channel &channel, const Data& pvValue) override;
+    bool endWrite() override;
+
+    bool beginRead() override { return true; }
+    bool readData(std::unordered_map<std::string, Data>& pvs) override;
+    bool readStream(RestoreSink& sink) override;
+    bool endRead() override { return true; }
+
+    void report(FILE* fp, int indent) override;
+
+protected:
+    /**
+     * \brief Values read from one shard, kept until every shard has been read. Names are packed into one string
+     */
+    struct ShardData : public RestoreSink {
+        struct Entry {
+            size_t name;
+            size_t nameLen;
+            Data value;
+        };
+
+        std::unique_ptr<fileSystemIO> io;
+        std::string names;
+        std::vector<Entry> entries;
+        bool ok = false;
+
+        void onData(const char* name, size_t nameLen, const Data& value) override {
+            entries.push_back({names.size(), nameLen, value});
+            names.append(name, nameLen);
+        }
+    };
+
+    struct Shard {
+        std::unique_ptr<fileSystemIO> io;
+        bool ok = false;
+    };
+
+    std::string shardPath(size_t index) const;
+    bool writeManifest();
+    bool readManifest(std::vector<std::string>& files);
+    epicsThreadPool* pool();
+
+    fileSystemIOType type_;
+    std::string path_;              // Manifest
+    std::vector<Shard> shards_;
+    size_t next_ = 0;               // Shard that gets the next channel
+    bool manifestWritten_ = false;
+    epicsThreadPool* pool_ = nullptr;
+};
+
+shardedFileSystemIO::shardedFileSystemIO(const char *name, const char *filePath, fileSystemIOType type, size_t shards)
+    : pvsave::SaveRestoreIO(name), type_(type), path_(filePath), shards_(shards) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        shards_[i].io.reset(new fileSystemIO(name, shardPath(i).c_str(), type, Unlisted()));
+}
+
+shardedFileSystemIO::~shardedFileSystemIO() {
+    if (pool_)
+        epicsThreadPoolDestroy(pool_);
+}
+
+/**
+ * Path of a shard: the shard number goes before the extension of the manifest's file name, or at the end if it has none
+ */
+std::string shardedFileSystemIO::shardPath(size_t index) const {
+    const size_t slash = path_.rfind('/');
+    size_t dot = path_.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1)
+        dot = path_.size();
+    return path_.substr(0, dot) + "." + std::to_string(index) + path_.substr(dot);
+}
+
+/**
+ * Threads for writing and reading shards, created on first use and kept for the life of the backend
+ */
+epicsThreadPool* shardedFileSystemIO::pool() {
+    if (!pool_ && shards_.size() > 1) {
+        epicsThreadPoolConfig conf;
+        epicsThreadPoolConfigDefaults(&conf);
+        conf.maxThreads = shards_.size() - 1;
+        conf.initialThreads = conf.maxThreads;
+        conf.workerStack = epicsThreadGetStackSize(epicsThreadStackMedium);
+        if (!(pool_ = epicsThreadPoolCreate(&conf)))
+            LOG_WARN("shardedFileSystemIO: unable to create thread pool, %s is handled serially\n", path_.c_str());
+    }
+    return pool_;
+}
+
+bool shardedFileSystemIO::beginWrite() {
+    next_ = 0;
+    bool ok = true;
+    for (auto& shard : shards_)
+        ok = shard.io->beginWrite() && ok;
+    return ok;
+}
+
+bool shardedFileSystemIO::writeData(const DataSource::Channel &channel, const Data& value) {
+    const bool ok = shards_[next_].io->writeData(channel, value);
+    next_ = next_ + 1 < shards_.size() ? next_ + 1 : 0;
+    return ok;
+}
+
+/**
+ * Write every shard on its own thread. The manifest only changes with the shard count, so it's written once, after the
+ * first complete set of shards
+ */
+bool shardedFileSystemIO::endWrite() {
+    runOnPool<Shard>(pool(), shards_, [](Shard& shard) {
+        shard.ok = shard.io->endWrite();
+    });
+
+    for (auto& shard : shards_) {
+        if (!shard.ok)
+            return false;
+    }
+    if (!manifestWritten_)
+        manifestWritten_ = writeManifest();
+    return manifestWritten_;
+}
+
+/**
+ * The manifest is one header line with the shard count, followed by the shard file names relative to the manifest
+ */
+bool shardedFileSystemIO::writeManifest() {
+    constexpr const char* funcName = "shardedFileSystemIO::writeManifest";
+    FILE* fp = fopen(path_.c_str(), "w");
+    if (!fp) {
+        LOG_ERR("%s: unable to open %s: %s\n", funcName, path_.c_str(), strerror(errno));
+        return false;
+    }
+    fprintf(fp, "pvSave shards %zu\n", shards_.size());
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        const std::string path = shardPath(i);
+        const size_t slash = path.rfind('/');
+        fprintf(fp, "%s\n", path.c_str() + (slash == std::string::npos ? 0 : slash + 1));
+    }
+    if (fclose(fp) != 0) {
+        LOG_ERR("%s: unable to write %s: %s\n", funcName, path_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the manifest into a list of shard paths
+ */
+bool shardedFileSystemIO::readManifest(std::vector<std::string>& files) {
+    constexpr const char* funcName = "shardedFileSystemIO::readManifest";
+    MappedFile file;
+    if (!file.open(path_.c_str())) {
+        LOG_ERR("%s: unable to map %s: %s\n", funcName, path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    const size_t slash = path_.rfind('/');
+    const std::string dir = slash == std::string::npos ? std::string() : path_.substr(0, slash + 1);
+
+    const char* p = file.data();
+    const char* const end = p + file.size();
+    size_t count = 0;
+    bool header = true;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        const char* line = p;
+        p = eol < end ? eol + 1 : end;
+        if (line == eol)
+            continue;
+
+        if (header) {
+            constexpr char HEADER[] = "pvSave shards ";
+            constexpr size_t HEADER_LEN = sizeof(HEADER) - 1;
+            if (size_t(eol - line) <= HEADER_LEN || memcmp(line, HEADER, HEADER_LEN) != 0
+                || parseNumber(line + HEADER_LEN, eol, count) != eol) {
+                LOG_ERR("%s: %s is not a shard manifest\n", funcName, path_.c_str());
+                return false;
+            }
+            header = false;
+            continue;
+        }
+        files.push_back(dir + std::string(line, eol - line));
+    }
+
+    if (header || files.size() != count) {
+        LOG_ERR("%s: %s lists %zu shards, expected %zu\n", funcName, path_.c_str(), files.size(), count);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read all shards listed in the manifest in parallel. The sink isn't thread safe, so each shard's values are buffered
+ * and handed over shard by shard once all of them have been read. Nothing is handed over if any shard can't be read
+ */
+bool shardedFileSystemIO::readStream(RestoreSink& sink) {
+    constexpr const char* funcName = "shardedFileSystemIO::readStream";
+    std::vector<std::string> files;
+    if (!readManifest(files))
+        return false;
+
+    std::vector<ShardData> shards(files.size());
+    for (size_t i = 0; i < files.size(); ++i)
+        shards[i].io.reset(new fileSystemIO(instName_.c_str(), files[i].c_str(), type_, Unlisted()));
+
+    runOnPool<ShardData>(pool(), shards, [](ShardData& shard) {
+        shard.ok = shard.io->readStream(shard);
+    });
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (!shards[i].ok) {
+            LOG_ERR("%s: unable to read shard %s\n", funcName, files[i].c_str());
+            return false;
+        }
+    }
+
+    for (auto& shard : shards) {
+        for (auto& entry : shard.entries)
+            sink.onData(shard.names.data() + entry.name, entry.nameLen, entry.value);
+        std::vector<ShardData::Entry>().swap(shard.entries);
+    }
+    return true;
+}
+
+bool shardedFileSystemIO::readData(std::unordered_map<std::string, Data>& pvs) {
+    MapSink sink(pvs);
+    return readStream(sink);
+}
+
+void shardedFileSystemIO::report(FILE* fp, int indent) {
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "shardedFileSystemIO\n");
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "manifest: %s\n", path_.c_str());
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "shards: %zu\n", shards_.size());
+    for (auto& shard : shards_)
+        shard.io->report(fp, indent + 4);
 }
 
 } // namespace pvsave
 
+/**
+ * Parse the fileFormat argument of the configure commands. No format means text
+ * \returns False if the format isn't known
+ */
+static bool parseFormat(const char *fileFormat, pvsave::fileSystemIOType &type) {
+    if (!fileFormat || !epicsStrCaseCmp(fileFormat, "text"))
+        type = pvsave::FSIO_TYPE_TEXT;
+    else if (!epicsStrCaseCmp(fileFormat, "json"))
+        type = pvsave::FSIO_TYPE_JSON;
+    else if (!epicsStrCaseCmp(fileFormat, "binary"))
+        type = pvsave::FSIO_TYPE_BINARY;
+    else if (!epicsStrCaseCmp(fileFormat, "journal"))
+        type = pvsave::FSIO_TYPE_JOURNAL;
+    else
+        return false;
+    return true;
+}
+
 static void pvSave_ConfigureFileSystemIOCallFunc(const iocshArgBuf *buf) {
     constexpr const char *funcName = "pvSave_ConfigureFileSystemIO";
     const char *ioName = buf[0].sval;
     const char *filePath = buf[1].sval;
     const char *fileFormat = buf[2].sval;
+    const int compactCycles = buf[3].ival;
+    const int compactBytes = buf[4].ival;
 
     if (!filePath || !ioName) {
-        printf("%s: filePath and ioName must be provided", funcName);
+        printf("%s: filePath and ioName must be provided\n", funcName);
+        iocshSetError(-1);
         return;
     }
 
-    fileFormat = fileFormat ? fileFormat : "text";
+    pvsave::fileSystemIOType type;
+    if (!parseFormat(fileFormat, type)) {
+        printf("%s: fileFormat must be text, json, binary or journal\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
 
-    pvsave::fileSystemIOType type = pvsave::FSIO_TYPE_TEXT;
-    if (!epicsStrCaseCmp(fileFormat, "text"))
-        type = pvsave::FSIO_TYPE_TEXT;
-    else if (!epicsStrCaseCmp(fileFormat, "json"))
-        type = pvsave::FSIO_TYPE_JSON;
+    if (compactCycles < 0 || compactBytes < 0) {
+        printf("%s: compactCycles and compactBytes must not be negative\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    new pvsave::fileSystemIO(ioName, filePath, type, compactCycles, compactBytes);
+}
+
+static void pvSave_ConfigureShardedFileSystemIOCallFunc(const iocshArgBuf *buf) {
+    constexpr const char *funcName = "pvSave_ConfigureShardedFileSystemIO";
+    const char *ioName = buf[0].sval;
+    const char *filePath = buf[1].sval;
+    const char *fileFormat = buf[2].sval;
+    const int shards = buf[3].ival;
+
+    if (!filePath || !ioName) {
+        printf("%s: filePath and ioName must be provided\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    pvsave::fileSystemIOType type;
+    if (!parseFormat(fileFormat, type) || type == pvsave::FSIO_TYPE_JOURNAL) {
+        printf("%s: fileFormat must be text, json or binary\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (shards < 1) {
+        printf("%s: shards must be >= 1\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
 
-    new pvsave::fileSystemIO(ioName, filePath, type);
+    new pvsave::shardedFileSystemIO(ioName, filePath, type, shards);
+}
+
+static void pvSave_SetTextParseThreadsCallFunc(const iocshArgBuf *buf) {
+    constexpr const char *funcName = "pvSave_SetTextParseThreads";
+    const int threads = buf[0].ival;
+
+    if (threads < 0) {
+        printf("%s: numThreads must be >= 0\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    s_parseThreads = threads;
 }
 
 void registerFSIO() {
@@ -447,10 +1201,31 @@ void registerFSIO() {
         static iocshArg arg0 = {"ioName", iocshArgString};
         static iocshArg arg1 = {"filePath", iocshArgString};
         static iocshArg arg2 = {"fileFormat", iocshArgString};
-        static iocshArg *args[] = {&arg0, &arg1, &arg2};
-        static iocshFuncDef funcDef = {"pvSave_ConfigureFileSystemIO", 3, args};
+        static iocshArg arg3 = {"compactCycles", iocshArgInt};
+        static iocshArg arg4 = {"compactBytes", iocshArgInt};
+        static iocshArg *args[] = {&arg0, &arg1, &arg2, &arg3, &arg4};
+        static iocshFuncDef funcDef = {"pvSave_ConfigureFileSystemIO", 5, args};
         iocshRegister(&funcDef, pvSave_ConfigureFileSystemIOCallFunc);
     }
+
+    /* pvSave_ConfigureShardedFileSystemIO */
+    {
+        static iocshArg arg0 = {"ioName", iocshArgString};
+        static iocshArg arg1 = {"filePath", iocshArgString};
+        static iocshArg arg2 = {"fileFormat", iocshArgString};
+        static iocshArg arg3 = {"shards", iocshArgInt};
+        static iocshArg *args[] = {&arg0, &arg1, &arg2, &arg3};
+        static iocshFuncDef funcDef = {"pvSave_ConfigureShardedFileSystemIO", 4, args};
+        iocshRegister(&funcDef, pvSave_ConfigureShardedFileSystemIOCallFunc);
+    }
+
+    /* pvSave_SetTextParseThreads */
+    {
+        static iocshArg arg0 = {"numThreads", iocshArgInt};
+        static iocshArg *args[] = {&arg0};
+        static iocshFuncDef funcDef = {"pvSave_SetTextParseThreads", 1, args};
+        iocshRegister(&funcDef, pvSave_SetTextParseThreadsCallFunc);
+    }
 }
 
 epicsExportRegistrar(registerFSIO);
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Read-only memory mapping of a whole file.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedFile.h"
+
+using namespace pvsave;
+
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        return false;
+    }
+    size_ = size_t(st.st_size);
+    if (!size_) {
+        ::close(fd);
+        return true;
+    }
+
+    // The zero-filled rest of the last page provides the terminator
+    const long page = sysconf(_SC_PAGESIZE);
+    if (page > 0 && size_ % size_t(page) != 0) {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(p, size_, MADV_SEQUENTIAL);
+#endif
+            map_ = p;
+            mapSize_ = size_;
+            data_ = static_cast<const char*>(p);
+            ::close(fd);
+            return true;
+        }
+    }
+
+    copy_.resize(size_ + 1);
+    size_t done = 0;
+    while (done < size_) {
+        const ssize_t n = ::read(fd, copy_.data() + done, size_ - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            const int err = n < 0 ? errno : EIO;
+            ::close(fd);
+            close();
+            errno = err;
+            return false;
+        }
+        done += size_t(n);
+    }
+    copy_[size_] = 0;
+    data_ = copy_.data();
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (map_)
+        munmap(map_, mapSize_);
+    map_ = nullptr;
+    mapSize_ = 0;
+    std::vector<char>().swap(copy_);
+    data_ = "";
+    size_ = 0;
+}
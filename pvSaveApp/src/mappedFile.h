@@ -0,0 +1,65 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Read-only memory mapping of a whole file.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace pvsave
+{
+
+/**
+ * \brief Maps a file read-only so parsers can work on it in place.
+ * The contents are always followed by a readable NUL, so parsers that stop at a delimiter (strtod and friends)
+ * can never run off the end. When the file size is an exact multiple of the page size there is no zero-filled
+ * tail to rely on, and on systems where mmap fails, the file is read into a heap buffer instead.
+ * The file must not be truncated while it is mapped.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * \brief Map a file. An empty file maps successfully, with size() 0
+     * \returns False on failure, with errno set
+     */
+    bool open(const char* path);
+
+    void close();
+
+    inline const char* data() const { return data_; }
+    inline size_t size() const { return size_; }
+
+    /**
+     * \brief True if the contents are mapped rather than copied
+     */
+    inline bool mapped() const { return map_ != nullptr; }
+
+private:
+    const char* data_ = "";
+    size_t size_ = 0;
+    void* map_ = nullptr;
+    size_t mapSize_ = 0;
+    std::vector<char> copy_;
+};
+
+} // namespace pvsave
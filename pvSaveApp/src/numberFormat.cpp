@@ -0,0 +1,550 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Number formatting and parsing without printf and strtod.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <cfloat>
+#include <cmath>
+#include <ctype.h>
+#include <errno.h>
+#include <limits>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "numberFormat.h"
+
+using namespace pvsave;
+
+const char pvsave::DIGIT_PAIRS[200] = {
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9',
+};
+
+/*
+ * Grisu2, from Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers" (PLDI 2010).
+ * The value and the boundaries of its rounding interval are scaled by a cached power of ten so that the integral
+ * part fits 32 bits, then digits are generated until the result is inside the (slightly narrowed) interval.
+ */
+namespace
+{
+
+// Floating point number f * 2^e with a 64 bit significand
+struct DiyFp {
+    uint64_t f;
+    int e;
+};
+
+inline DiyFp sub(DiyFp x, DiyFp y)
+{
+    return {x.f - y.f, x.e};
+}
+
+// Upper 64 bits of the product, rounded
+inline DiyFp mul(DiyFp x, DiyFp y)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 p = static_cast<unsigned __int128>(x.f) * y.f;
+    const uint64_t h = uint64_t(p >> 64) + (uint64_t(p) >> 63);
+#else
+    const uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+    const uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+    const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    const uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu) + (uint64_t(1) << 31);
+    const uint64_t h = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+#endif
+    return {h, x.e + y.e + 64};
+}
+
+inline DiyFp normalize(DiyFp x)
+{
+    while (!(x.f >> 63)) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+struct Boundaries {
+    DiyFp w;        // The value
+    DiyFp minus;    // Halfway to the next lower value
+    DiyFp plus;     // Halfway to the next higher value
+};
+
+/*
+ * Value and rounding interval of a positive, finite float or double, normalized with a common exponent.
+ * Using the float's own interval gives the digits needed to round trip through a float
+ */
+template<typename T, typename Bits>
+Boundaries computeBoundaries(T value)
+{
+    constexpr int precision = std::numeric_limits<T>::digits;  // Including the hidden bit
+    constexpr int bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+    constexpr uint64_t hiddenBit = uint64_t(1) << (precision - 1);
+
+    Bits bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint64_t exp = uint64_t(bits) >> (precision - 1);
+    const uint64_t frac = uint64_t(bits) & (hiddenBit - 1);
+
+    const DiyFp v = exp == 0 ? DiyFp{frac, 1 - bias} : DiyFp{frac + hiddenBit, int(exp) - bias};
+
+    // The interval is asymmetric at powers of two, the next lower value is closer
+    const bool lowerCloser = frac == 0 && exp > 1;
+    const DiyFp plus = normalize({2 * v.f + 1, v.e - 1});
+    DiyFp minus = lowerCloser ? DiyFp{4 * v.f - 1, v.e - 2} : DiyFp{2 * v.f - 1, v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    return {normalize(v), minus, plus};
+}
+
+struct CachedPower {
+    uint64_t f;
+    int e;
+    int k;      // 10^k ~= f * 2^e
+};
+
+// 10^k for k = -300, -292, ..., 324, rounded to 64 bits
+constexpr int CACHED_POWERS_MIN_EXP = -300;
+constexpr int CACHED_POWERS_STEP = 8;
+constexpr CachedPower CACHED_POWERS[] = {
+{0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C,  -980, -276},
+    {0xD3515C2831559A83,  -954, -268},
+    {0x9D71AC8FADA6C9B5,  -927, -260},
+    {0xEA9C227723EE8BCB,  -901, -252},
+    {0xAECC49914078536D,  -874, -244},
+    {0x823C12795DB6CE57,  -847, -236},
+    {0xC21094364DFB5637,  -821, -228},
+    {0x9096EA6F3848984F,  -794, -220},
+    {0xD77485CB25823AC7,  -768, -212},
+    {0xA086CFCD97BF97F4,  -741, -204},
+    {0xEF340A98172AACE5,  -715, -196},
+    {0xB23867FB2A35B28E,  -688, -188},
+    {0x84C8D4DFD2C63F3B,  -661, -180},
+    {0xC5DD44271AD3CDBA,  -635, -172},
+    {0x936B9FCEBB25C996,  -608, -164},
+    {0xDBAC6C247D62A584,  -582, -156},
+    {0xA3AB66580D5FDAF6,  -555, -148},
+    {0xF3E2F893DEC3F126,  -529, -140},
+    {0xB5B5ADA8AAFF80B8,  -502, -132},
+    {0x87625F056C7C4A8B,  -475, -124},
+    {0xC9BCFF6034C13053,  -449, -116},
+    {0x964E858C91BA2655,  -422, -108},
+    {0xDFF9772470297EBD,  -396, -100},
+    {0xA6DFBD9FB8E5B88F,  -369,  -92},
+    {0xF8A95FCF88747D94,  -343,  -84},
+    {0xB94470938FA89BCF,  -316,  -76},
+    {0x8A08F0F8BF0F156B,  -289,  -68},
+    {0xCDB02555653131B6,  -263,  -60},
+    {0x993FE2C6D07B7FAC,  -236,  -52},
+    {0xE45C10C42A2B3B06,  -210,  -44},
+    {0xAA242499697392D3,  -183,  -36},
+    {0xFD87B5F28300CA0E,  -157,  -28},
+    {0xBCE5086492111AEB,  -130,  -20},
+    {0x8CBCCC096F5088CC,  -103,  -12},
+    {0xD1B71758E219652C,   -77,   -4},
+    {0x9C40000000000000,   -50,    4},
+    {0xE8D4A51000000000,   -24,   12},
+    {0xAD78EBC5AC620000,     3,   20},
+    {0x813F3978F8940984,    30,   28},
+    {0xC097CE7BC90715B3,    56,   36},
+    {0x8F7E32CE7BEA5C70,    83,   44},
+    {0xD5D238A4ABE98068,   109,   52},
+    {0x9F4F2726179A2245,   136,   60},
+    {0xED63A231D4C4FB27,   162,   68},
+    {0xB0DE65388CC8ADA8,   189,   76},
+    {0x83C7088E1AAB65DB,   216,   84},
+    {0xC45D1DF942711D9A,   242,   92},
+    {0x924D692CA61BE758,   269,  100},
+    {0xDA01EE641A708DEA,   295,  108},
+    {0xA26DA3999AEF774A,   322,  116},
+    {0xF209787BB47D6B85,   348,  124},
+    {0xB454E4A179DD1877,   375,  132},
+    {0x865B86925B9BC5C2,   402,  140},
+    {0xC83553C5C8965D3D,   428,  148},
+    {0x952AB45CFA97A0B3,   455,  156},
+    {0xDE469FBD99A05FE3,   481,  164},
+    {0xA59BC234DB398C25,   508,  172},
+    {0xF6C69A72A3989F5C,   534,  180},
+    {0xB7DCBF5354E9BECE,   561,  188},
+    {0x88FCF317F22241E2,   588,  196},
+    {0xCC20CE9BD35C78A5,   614,  204},
+    {0x98165AF37B2153DF,   641,  212},
+    {0xE2A0B5DC971F303A,   667,  220},
+    {0xA8D9D1535CE3B396,   694,  228},
+    {0xFB9B7CD9A4A7443C,   720,  236},
+    {0xBB764C4CA7A44410,   747,  244},
+    {0x8BAB8EEFB6409C1A,   774,  252},
+    {0xD01FEF10A657842C,   800,  260},
+    {0x9B10A4E5E9913129,   827,  268},
+    {0xE7109BFBA19C0C9D,   853,  276},
+    {0xAC2820D9623BF429,   880,  284},
+    {0x80444B5E7AA7CF85,   907,  292},
+    {0xBF21E44003ACDD2D,   933,  300},
+    {0x8E679C2F5E44FF8F,   960,  308},
+    {0xD433179D9C8CB841,   986,  316},
+    {0x9E19DB92B4E31BA9,  1013,  324},
+};
+
+// The scaled value's integral part must fit 32 bits, and generating digits mustn't overflow
+constexpr int ALPHA = -60;
+constexpr int GAMMA = -32;
+
+// Power of ten that scales a number with binary exponent e into [ALPHA, GAMMA]
+inline const CachedPower& cachedPowerFor(int e)
+{
+    // ceil((ALPHA - e - 1) * log10(2)), with log10(2) ~= 78913 / 2^18
+    const int f = ALPHA - e - 1;
+    const int k = (f * 78913) / (1 << 18) + int(f > 0);
+    const int index = (-CACHED_POWERS_MIN_EXP + k + (CACHED_POWERS_STEP - 1)) / CACHED_POWERS_STEP;
+    return CACHED_POWERS[index];
+}
+
+// Number of decimal digits of n, and 10^(digits - 1)
+inline int decimalDigits(uint32_t n, uint32_t& pow10)
+{
+    int digits = 1;
+    pow10 = 1;
+    while (digits < 10 && n / pow10 >= 10) {
+        pow10 *= 10;
+        ++digits;
+    }
+    return digits;
+}
+
+// Move the last digit towards the exact value, as long as the result stays inside the interval
+inline void roundWeed(char* buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK)
+{
+    while (rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+        --buf[len - 1];
+        rest += tenK;
+    }
+}
+
+/*
+ * Generate the digits of a number in [minus, plus], as close to w as possible.
+ * All three share the exponent, which is in [ALPHA, GAMMA]
+ */
+void digitGen(char* buf, int& len, int& exp10, DiyFp minus, DiyFp w, DiyFp plus)
+{
+    uint64_t delta = sub(plus, minus).f;
+    uint64_t dist = sub(plus, w).f;
+
+    const int shift = -plus.e;
+    const uint64_t one = uint64_t(1) << shift;
+    uint32_t p1 = uint32_t(plus.f >> shift);    // Integral part
+    uint64_t p2 = plus.f & (one - 1);           // Fractional part
+
+    uint32_t pow10;
+    int n = decimalDigits(p1, pow10);
+    while (n > 0) {
+        buf[len++] = char('0' + p1 / pow10);
+        p1 %= pow10;
+        --n;
+        const uint64_t rest = (uint64_t(p1) << shift) + p2;
+        if (rest <= delta) {
+            exp10 += n;
+            roundWeed(buf, len, dist, delta, rest, uint64_t(pow10) << shift);
+            return;
+        }
+        pow10 /= 10;
+    }
+
+    int m = 0;
+    for (;;) {
+        p2 *= 10;
+        buf[len++] = char('0' + (p2 >> shift));
+        p2 &= one - 1;
+        ++m;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta)
+            break;
+    }
+    exp10 -= m;
+    roundWeed(buf, len, dist, delta, p2, one);
+}
+
+/*
+ * Digits of a positive finite value, such that value ~= digits * 10^exp10
+ */
+template<typename T, typename Bits>
+int grisu2(T value, char* buf, int& exp10)
+{
+    const Boundaries b = computeBoundaries<T, Bits>(value);
+    const CachedPower& c = cachedPowerFor(b.plus.e);
+    const DiyFp scale = {c.f, c.e};
+
+    const DiyFp w = mul(b.w, scale);
+    DiyFp minus = mul(b.minus, scale);
+    DiyFp plus = mul(b.plus, scale);
+
+    // Both products may be off by one, stay on the safe side
+    ++minus.f;
+    --plus.f;
+
+    int len = 0;
+    exp10 = -c.k;
+    digitGen(buf, len, exp10, minus, w, plus);
+    return len;
+}
+
+/*
+ * Lay out digits * 10^exp10 like %g would with maxDigits of precision, but without trailing zeros
+ */
+size_t formatDigits(char* p, const char* digits, int len, int exp10, int maxDigits)
+{
+    char* const start = p;
+    const int point = len + exp10;      // Position of the decimal point relative to the first digit
+
+    if (exp10 >= 0 && point <= maxDigits) {
+        // Integer: 1234500
+        memcpy(p, digits, len);
+        p += len;
+        memset(p, '0', exp10);
+        p += exp10;
+    }
+    else if (point > 0 && point <= maxDigits) {
+        // 123.45
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, len - point);
+        p += len - point;
+    }
+    else if (point > -4 && point <= 0) {
+        // 0.0012345
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, len);
+        p += len;
+    }
+    else {
+        // 1.2345e+67
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        int e = point - 1;
+        *p++ = 'e';
+        *p++ = e < 0 ? '-' : '+';
+        if (e < 0)
+            e = -e;
+        if (e >= 100) {
+            *p++ = char('0' + e / 100);
+            e %= 100;
+        }
+        *p++ = DIGIT_PAIRS[e * 2];
+        *p++ = DIGIT_PAIRS[e * 2 + 1];
+    }
+    return p - start;
+}
+
+template<typename T, typename Bits>
+size_t formatShortest(T value, char* p, int maxDigits)
+{
+    char* const start = p;
+    if (value != value) {
+        Bits bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if (bits >> (sizeof(Bits) * 8 - 1))
+            *p++ = '-';
+        memcpy(p, "nan", 3);
+        return p + 3 - start;
+    }
+
+    if (std::signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (value == std::numeric_limits<T>::infinity()) {
+        memcpy(p, "inf", 3);
+        return p + 3 - start;
+    }
+    if (value == 0) {
+        *p++ = '0';
+        return p - start;
+    }
+
+    char digits[20];
+    int exp10;
+    const int len = grisu2<T, Bits>(value, digits, exp10);
+    return p - start + formatDigits(p, digits, len, exp10, maxDigits);
+}
+
+} // namespace
+
+size_t pvsave::formatDouble(double value, char* p)
+{
+    return formatShortest<double, uint64_t>(value, p, std::numeric_limits<double>::max_digits10);
+}
+
+size_t pvsave::formatFloat(float value, char* p)
+{
+    return formatShortest<float, uint32_t>(value, p, std::numeric_limits<float>::max_digits10);
+}
+
+/*
+ * Clinger's fast path: if the significand and the power of ten are both exact in the type, one multiplication or division
+ * rounds correctly. Only valid if the compiler doesn't evaluate in extra precision, as x87 does
+ */
+namespace
+{
+
+constexpr double DOUBLE_POWERS[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+constexpr float FLOAT_POWERS[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+inline double strtoT(const char* p, char** end, double*) { return strtod(p, end); }
+inline float strtoT(const char* p, char** end, float*) { return strtof(p, end); }
+
+// Everything the fast path can't handle. strto* needs a terminator, so parse a copy.
+// Tokens too long for the stack buffer (hundreds of digits are valid) are copied to the heap rather than cut short
+template<typename T>
+const char* parseSlow(const char* p, const char* end, T& out)
+{
+    char stackBuf[128];
+    std::string heapBuf;
+    const size_t len = size_t(end - p);
+    char* buf = stackBuf;
+    if (len >= sizeof(stackBuf)) {
+        heapBuf.assign(p, len);
+        buf = &heapBuf[0];
+    }
+    else {
+        memcpy(buf, p, len);
+        buf[len] = 0;
+    }
+
+    char* stop;
+    errno = 0;
+    const T v = strtoT(buf, &stop, static_cast<T*>(nullptr));
+    if (stop == buf || (errno == ERANGE && std::isinf(v)))
+        return nullptr;
+    out = v;
+    return p + (stop - buf);
+}
+
+inline bool isDigit(char c)
+{
+    return unsigned(c - '0') < 10;
+}
+
+template<typename T, size_t NPOWERS>
+const char* parseFloating(const char* p, const char* end, T& out, const T (&powers)[NPOWERS])
+{
+    const char* const start = p;
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    constexpr uint64_t maxExact = uint64_t(1) << std::numeric_limits<T>::digits;
+    constexpr int maxExp10 = int(NPOWERS) - 1;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    // Significand, up to the 19 digits that always fit
+    uint64_t w = 0;
+    int digits = 0;
+    int exp10 = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); ++p) {
+        if (digits >= 19)
+            return parseSlow(start, end, out);
+        w = w * 10 + unsigned(*p - '0');
+        digits += w != 0;
+        any = true;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            if (digits >= 19)
+                return parseSlow(start, end, out);
+            w = w * 10 + unsigned(*p - '0');
+            digits += w != 0;
+            --exp10;
+            any = true;
+        }
+    }
+    // Not a decimal number, nan or inf maybe
+    if (!any)
+        return parseSlow(start, end, out);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool expNeg = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            expNeg = *q++ == '-';
+        // Without digits the 'e' isn't part of the number
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); ++q) {
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+            }
+            exp10 += expNeg ? -e : e;
+            p = q;
+        }
+    }
+
+    // Hex floats and the like
+    if (p < end && isalpha((unsigned char)*p))
+        return parseSlow(start, end, out);
+
+    if (w > maxExact || exp10 < -maxExp10 || exp10 > maxExp10)
+        return parseSlow(start, end, out);
+
+    T v = T(w);
+    v = exp10 < 0 ? v / powers[-exp10] : v * powers[exp10];
+    out = neg ? -v : v;
+    return p;
+#else
+    (void)powers;
+    return parseSlow(start, end, out);
+#endif
+}
+
+} // namespace
+
+const char* pvsave::parseNumber(const char* p, const char* end, double& out)
+{
+    return parseFloating(p, end, out, DOUBLE_POWERS);
+}
+
+const char* pvsave::parseNumber(const char* p, const char* end, float& out)
+{
+    return parseFloating(p, end, out, FLOAT_POWERS);
+}
@@ -0,0 +1,126 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Number formatting and parsing without printf and strtod.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits>
+#include <string.h>
+#include <type_traits>
+
+namespace pvsave
+{
+
+/**
+ * \brief Room needed by the format functions. None of them NUL terminate
+ */
+constexpr size_t NUMBER_BUFFER_SIZE = 32;
+
+/**
+ * \brief "00" "01" ... "99", for formatting two digits at a time
+ */
+extern const char DIGIT_PAIRS[200];
+
+/**
+ * \brief Format an integer in decimal
+ * \returns Number of characters written to p
+ */
+template<typename T>
+inline size_t formatInteger(T value, char* p)
+{
+    static_assert(std::is_integral<T>::value, "formatInteger needs an integer");
+    char tmp[24];
+    char* const e = tmp + sizeof(tmp);
+    char* b = e;
+    // Work on the magnitude as unsigned, so the most negative value doesn't overflow
+    uint64_t mag = value < 0 ? 0 - uint64_t(value) : uint64_t(value);
+    while (mag >= 100) {
+        const unsigned pair = unsigned(mag % 100) * 2;
+        mag /= 100;
+        b -= 2;
+        b[0] = DIGIT_PAIRS[pair];
+        b[1] = DIGIT_PAIRS[pair + 1];
+    }
+    if (mag >= 10) {
+        b -= 2;
+        b[0] = DIGIT_PAIRS[mag * 2];
+        b[1] = DIGIT_PAIRS[mag * 2 + 1];
+    }
+    else
+        *--b = char('0' + mag);
+    if (value < 0)
+        *--b = '-';
+    memcpy(p, b, e - b);
+    return e - b;
+}
+
+/**
+ * \brief Format a number with the fewest digits that still parse back to the same value
+ * Uses Grisu2, which always round trips and is the shortest possible for all but a tiny fraction of inputs.
+ * Like %g, the exponent form is used for very large and very small values. NaN and infinities are written
+ * the way printf does, which strtod accepts
+ * \returns Number of characters written to p
+ */
+size_t formatDouble(double value, char* p);
+
+/**
+ * \brief Like formatDouble, but with the digits needed to get back the same float
+ */
+size_t formatFloat(float value, char* p);
+
+/**
+ * \brief Parse a decimal integer at the start of [p, end), like std::from_chars but with an optional sign and leading whitespace
+ * A '-' is only accepted for signed types, except for "-0"
+ * \returns Pointer past the last digit, or nullptr if there are no digits or the value doesn't fit T. out is untouched then
+ */
+template<typename T>
+inline const char* parseNumber(const char* p, const char* end, T& out)
+{
+    static_assert(std::is_integral<T>::value, "parseNumber needs an integer type");
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    // Accumulate the magnitude, anything beyond the limit of the type is rejected as soon as it's seen
+    const uint64_t limit = neg ? uint64_t(0) - uint64_t(std::numeric_limits<T>::min()) : uint64_t(std::numeric_limits<T>::max());
+    const char* const digits = p;
+    uint64_t mag = 0;
+    for (; p < end && unsigned(*p - '0') < 10; ++p) {
+        const unsigned d = unsigned(*p - '0');
+        if (mag > limit / 10 || (mag == limit / 10 && d > limit % 10))
+            return nullptr;
+        mag = mag * 10 + d;
+    }
+    if (p == digits)
+        return nullptr;
+    out = T(neg ? 0 - mag : mag);
+    return p;
+}
+
+/**
+ * \brief Parse a floating point number at the start of [p, end), like std::from_chars with leading whitespace allowed
+ * Decimal numbers of up to 19 significant digits whose value is exact in the type are computed directly (Clinger's fast
+ * path), which covers nearly everything formatDouble() writes. Anything else, including nan, inf and hex floats, is handed
+ * to strtod/strtof from a copy on the stack
+ * \returns Pointer past the number, or nullptr if there is none or it overflows. out is untouched then
+ */
+const char* parseNumber(const char* p, const char* end, double& out);
+const char* parseNumber(const char* p, const char* end, float& out);
+
+} // namespace pvsave
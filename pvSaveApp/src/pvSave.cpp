@@ -14,24 +14,30 @@
  * ----------------------------------------------------------------------------
  **/
 
+#include <algorithm>
 #include <atomic>
 #include <list>
 #include <memory>
+#include <queue>
 #include <stdio.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "channelIndex.h"
 #include "common.h"
+#include "writerThread.h"
 #include "pvsave/pvSave.h"
 
 #include "dbScan.h"
 #include "epicsAlgorithm.h"
+#include "epicsEvent.h"
 #include "epicsExport.h"
 #include "epicsStdio.h"
 #include "epicsStdlib.h"
 #include "epicsString.h"
 #include "epicsThread.h"
+#include "epicsThreadPool.h"
 #include "epicsTime.h"
 #include "initHooks.h"
 #include "iocsh.h"
@@ -42,15 +48,25 @@
 using namespace pvsave;
 
 constexpr int MAX_LINE_LENGTH = 1024;
+constexpr size_t CAPTURE_CHUNK = 256;  // Channels read per getMany() while capturing a full snapshot
 
 static int s_configuredThreadPriority = epicsThreadPriorityLow;
 static epicsThreadId s_threadId = 0;
+static int s_restoreThreads = 0;    // Threads for parsing save data, > 1 parses sets of the same stage concurrently
+static bool s_restorePrefetch = true; // Parse save data in the background from initHookAtIocBuild on
 
 static epicsTimeStamp s_lastProcTime;
+static epicsTimeStamp s_lastChangedTime;
 static int s_lastStatus;
 
 ELoggingLevel pvsave::logLevel = ELoggingLevel::LL_Info;
 
+std::atomic<size_t>& pvsave::captureBufferGrowth()
+{
+    static std::atomic<size_t> count{0};
+    return count;
+}
+
 /** Global list of IO backend instances */
 std::unordered_map<std::string, pvsave::SaveRestoreIO*>& pvsave::ioBackends()
 {
@@ -76,6 +92,15 @@ epicsMutex& contextGuard()
     return mutex;
 }
 
+/**
+ * \brief Controls when a monitor set writes to its IO backends
+ */
+enum ESaveMode {
+    SM_Periodic = 0,    //< Write every period, regardless of whether anything changed
+    SM_OnChange,        //< Read every period, but only write if a value changed since the last save
+    SM_Event,           //< Subscribe to value events, only read channels that posted one and write if any changed
+};
+
 /**
  * \brief Describes a set of PVs to be monitored and saved at a specific rate
  * A monitor set may have multiple IO backends associated with it
@@ -84,15 +109,22 @@ struct MonitorSet {
     MonitorSet(const std::string& _name, double _period) :
         name(_name),
         period(_period),
-        stage(-1)
+        stage(-1),
+        mode(SM_Periodic),
+        priority(0),
+        phase(0)
     {
     }
     std::string name;
     double period;
 
     int stage;
+    ESaveMode mode;
+    int priority;       // Sets due at the same time are saved highest priority first
+    double phase;       // Offset of the save schedule, in seconds. Use to spread out sets with the same period
     std::vector<pvsave::SaveRestoreIO*> io;
     std::vector<std::string> pvList;
+    std::unordered_map<std::string, double> deadbands; // By PV name, for float and double PVs
     class SaveContext* context;
 };
 
@@ -107,15 +139,27 @@ class SaveContext
 {
 public:
     SaveContext(std::shared_ptr<MonitorSet> set) :
-        monitorSet_(set)
+        monitorSet_(set),
+        ioStatus_(std::make_shared<std::atomic<uint32_t>>(0))
     {
         monitorSet_->context = this;
     }
 
     void init();
-    bool save();
+    void group();
+    void subscribe();
+    bool save(bool force = false);
     bool restore(pvsave::SaveRestoreIO* io);
     bool restore();
+    void beginParse();
+    bool parseRestore();
+    void applyRestore();
+
+    // True between beginParse() and applyRestore()
+    inline bool parsing() const
+    {
+        return parsed_ != nullptr;
+    }
 
     // Returns the channels
     inline const std::vector<pvsave::DataSource::Channel>& channels() const
@@ -129,15 +173,50 @@ public:
         return monitorSet_;
     }
 
+    // Returns 1 if the last capture or any backend's last write failed
+    inline int status() const
+    {
+        return (lastStatus_ || *ioStatus_) ? 1 : 0;
+    }
+
     static std::vector<SaveContext> saveContexts;
 
     epicsTimeStamp lastProc_ = {0, 0};
+    epicsTimeStamp lastChanged_ = {0, 0};
     int lastStatus_ = 0;
+    size_t lastCycleGrowth_ = 0;    // captureBufferGrowth() of the last save cycle
+    size_t totalGrowth_ = 0;
+    size_t snapshotBytes_ = 0;      // Size of one snapshot buffer, not counting array contents
+    double restoreTime_ = 0;        // Wall time of the last restore, in seconds
 
 protected:
     std::shared_ptr<MonitorSet> monitorSet_;
     std::vector<pvsave::DataSource::Channel> channels_;
+    pvsave::ChannelIndex index_;                     // Name lookup into channels_, rebuilt whenever they're reordered
+    pvsave::ColumnLayout layout_;                    // Snapshot column of each channel, rebuilt whenever they're reordered
+    std::shared_ptr<const pvsave::Snapshot> last_;   // Most recent capture, used for change detection and handed to writers
+    uint64_t sequence_ = 0;                          // Sequence number of last_
+    std::shared_ptr<std::atomic<uint32_t>> ioStatus_; // Bit n set if the last write to monitorSet_->io[n] failed
+    std::vector<std::shared_ptr<pvsave::Snapshot>> pool_; // Snapshot buffers, reused once no writer references them
+    std::vector<pvsave::Data> scratch_;              // Read buffer, snapshots are filled through this in chunks
+    std::unique_ptr<pvsave::ChangeTracker> tracker_; // Dirty bitmap filled by the data source in SM_Event mode
+    bool subscribed_ = false;                        // True if tracker_ covers every channel
+    std::vector<uint32_t> belowDeadband_;            // Channels whose last event was within their deadband, so last_ is behind. Laid out like tracker_'s words
+    bool typeWarned_ = false;                        // Logged a value that didn't fit its column
     bool pendingRestore_ = false;
+    pvsave::ChannelIndex pvIndex_;                   // Name lookup into monitorSet_->pvList, only while parsing
+    std::vector<pvsave::Data> restoreBuf_;           // Parsed restore data, 1:1 with monitorSet_->pvList. Only used by buffered restores
+    std::vector<uint8_t> restoreFound_;              // Non-zero if restoreBuf_[i] was found in the save data
+    std::unique_ptr<epicsEvent> parsed_;             // Signalled once parseRestore() is done
+    double parseTime_ = 0;
+
+    class ChannelSink;
+    bool read(pvsave::SaveRestoreIO* io, pvsave::RestoreSink& sink);
+    std::shared_ptr<pvsave::Snapshot> acquireSnapshot();
+    void storeValue(pvsave::Snapshot& snap, size_t channel, const pvsave::Data& value);
+    void markAllChanged(pvsave::Snapshot& snap);
+    bool captureAll(bool writeAll);
+    bool captureDirty(bool writeAll);
 };
 
 std::vector<SaveContext> SaveContext::saveContexts;
@@ -152,57 +231,232 @@ std::vector<SaveContext> SaveContext::saveContexts;
 void SaveContext::init()
 {
     pvsave::dataSource()->connect(monitorSet_->pvList, channels_);
+    index_.build(channels_);
+    layout_.build(channels_, &monitorSet_->deadbands);
+    scratch_.resize(CAPTURE_CHUNK);
 }
 
 /**
- * Save all data to all registered I/O backends
+ * Called once locksets exist, lets the data source reorder channels for batching
  */
-bool SaveContext::save()
+void SaveContext::group()
 {
-    lastStatus_ = 0;
+    pvsave::dataSource()->group(channels_);
+    index_.build(channels_);
+    layout_.build(channels_, &monitorSet_->deadbands);
 
-    std::vector<pvsave::Data> data;
-    data.resize(channels_.size());
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        pvsave::dataSource()->get(channels_[i], data[i]);
-    }
-    
-    std::vector<pvsave::SaveRestoreIO*> ios;
-    ios.reserve(16);
-    
-    // Begin read on each of our monitor sets
-    for (auto& io : monitorSet_->io) {
-        if (io->flags() & pvsave::SaveRestoreIO::Write) {
-            if (!io->beginWrite()) {
-                LOG_ERR("pvSave: io->beginWrite: save failed\n");
-                lastStatus_ = 1;
-                continue;
-            }
-            ios.push_back(io);
+    // Any snapshot taken so far uses the old layout
+    last_.reset();
+    pool_.clear();
+}
+
+/**
+ * Subscribe to value events for SM_Event monitor sets. Falls back to polling if the data source can't deliver them
+ */
+void SaveContext::subscribe()
+{
+    if (monitorSet_->mode != SM_Event)
+        return;
+
+    // The tracker is kept alive even on failure; any subscriptions that did succeed still point at it
+    tracker_.reset(new pvsave::ChangeTracker());
+    subscribed_ = pvsave::dataSource()->subscribe(channels_, *tracker_);
+    belowDeadband_.assign(tracker_->words(), 0);
+    if (!subscribed_)
+        LOG_WARN("pvSave: %s: unable to subscribe to all channels, falling back to polling\n", monitorSet_->name.c_str());
+    else
+        LOG_INFO("pvSave: %s: subscribed to %zu channels\n", monitorSet_->name.c_str(), channels_.size());
+}
+
+/**
+ * Returns a snapshot buffer that nobody else references, sized for our channels.
+ * Buffers are recycled once the writers are done with them, so after the first few cycles this doesn't allocate
+ */
+std::shared_ptr<pvsave::Snapshot> SaveContext::acquireSnapshot()
+{
+    for (auto& snap : pool_) {
+        // Only this thread hands out references, so a count of 1 can't go back up behind our back
+        if (snap.use_count() == 1) {
+            // Pairs with the release in the writer's shared_ptr decrement, so its reads are done before we overwrite
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return snap;
         }
     }
-    
-    // Read the data from each of the open channels
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        pvsave::Data data;
-        pvsave::dataSource()->get(channels_[i], data);
-
-        // Forward the data to each of the IO backends
-        for (auto& io : ios) {
-            if (!io->writeData(channels_[i], data)) {
-                LOG_ERR("pvSave: io->writeData: save failed\n");
-                lastStatus_ = 1;
-                // Fall-through to allow cleanup
+
+    auto snap = std::make_shared<pvsave::Snapshot>();
+    snap->setName = monitorSet_->name.c_str();
+    snap->channels = &channels_;
+    snap->ioStatus = ioStatus_;
+    snap->data.reset(layout_);
+    pool_.push_back(snap);
+    snapshotBytes_ = snap->data.memoryUsage();
+    ++pvsave::captureBufferGrowth();
+    return snap;
+}
+
+/**
+ * Store a captured value into its snapshot column.
+ * The layout is built from the data source's channel types, so a mismatch means the data source broke that promise.
+ * Only the first one is logged, this runs every cycle
+ */
+void SaveContext::storeValue(pvsave::Snapshot& snap, size_t channel, const pvsave::Data& value)
+{
+    if (!snap.data.store(channel, value) && !typeWarned_) {
+        LOG_WARN("pvSave: %s: %s returned an unexpected type, value dropped\n", monitorSet_->name.c_str(),
+            channels_[channel].channelName.c_str());
+        typeWarned_ = true;
+    }
+}
+
+/**
+ * Mark every channel of a snapshot as changed, for the first one taken
+ */
+void SaveContext::markAllChanged(pvsave::Snapshot& snap)
+{
+    snap.changed.assign((channels_.size() + 63) / 64, ~uint64_t(0));
+    if (channels_.size() % 64)
+        snap.changed.back() = (uint64_t(1) << (channels_.size() % 64)) - 1;
+}
+
+/**
+ * Read every channel into a recycled snapshot
+ * \param writeAll The snapshot is written regardless of deadbands (periodic or forced save), so keep it if anything moved at all
+ * \returns True if any value differs from the previous snapshot by more than its deadband
+ */
+bool SaveContext::captureAll(bool writeAll)
+{
+    auto snap = acquireSnapshot();
+    for (size_t base = 0; base < channels_.size(); base += scratch_.size()) {
+        const size_t count = epicsMin(scratch_.size(), channels_.size() - base);
+        pvsave::dataSource()->getMany(&channels_[base], scratch_.data(), count);
+        for (size_t i = 0; i < count; ++i)
+            storeValue(*snap, base + i, scratch_[i]);
+    }
+
+    // Compare against the previous snapshot. The first save always counts as a change
+    bool changed = true;
+    bool moved = false;
+    if (last_) {
+        changed = snap->data.diff(last_->data, snap->changed) != 0;
+        // Changes within the deadbands are still written, marked as changed so delta backends include them
+        if (writeAll && (layout_.floatDeadbands() || layout_.doubleDeadbands()))
+            moved = snap->data.diff(last_->data, snap->changed, false) != 0;
+    }
+    else
+        markAllChanged(*snap);
+
+    // Unchanged snapshots simply go back to the pool
+    if (changed || moved) {
+        snap->sequence = ++sequence_;
+        last_ = std::move(snap);
+    }
+    return changed;
+}
+
+/**
+ * Read only the channels that posted an event since the last capture
+ * The previous snapshot may still be queued on a writer, so changes go into a copy of it
+ * \param writeAll The snapshot is written regardless of deadbands (forced save), so also take changes within them
+ * \returns True if any value differs from the previous snapshot by more than its deadband
+ */
+bool SaveContext::captureDirty(bool writeAll)
+{
+    std::shared_ptr<pvsave::Snapshot> snap;
+    bool changed = !last_;
+    if (!last_) {
+        snap = acquireSnapshot();
+        markAllChanged(*snap);
+    }
+
+    if (tracker_->takeAnyDirty() || writeAll) {
+        // Read each run of consecutive dirty channels with one batched get
+        for (size_t w = 0; w < tracker_->words(); ++w) {
+            uint32_t bits = tracker_->takeWord(w);
+            // Channels whose events were all within the deadband have posted nothing since, re-read them too
+            if (writeAll) {
+                bits |= belowDeadband_[w];
+                belowDeadband_[w] = 0;
+            }
+            while (bits) {
+                size_t first = 0, count = 0;
+                while (!(bits & (1u << first)))
+                    ++first;
+                while (first + count < 32 && (bits & (1u << (first + count))))
+                    ++count;
+                bits &= count < 32 ? ~(((1u << count) - 1) << first) : 0;
+
+                const size_t base = w * 32 + first;
+                pvsave::dataSource()->getMany(&channels_[base], scratch_.data(), count);
+
+                for (size_t i = 0; i < count; ++i) {
+                    const size_t channel = base + i;
+                    if (last_) {
+                        // Events may be posted without the value actually changing, or by less than the deadband
+                        if (!last_->data.changed(channel, scratch_[i])) {
+                            if (last_->data.equals(channel, scratch_[i]))
+                                continue;
+                            if (!writeAll) {
+                                belowDeadband_[w] |= 1u << (channel % 32);
+                                continue;
+                            }
+                        }
+                        else
+                            changed = true;
+                        if (!snap) {
+                            snap = acquireSnapshot();
+                            snap->data = last_->data;
+                            snap->changed.assign(last_->changed.size(), 0);
+                        }
+                        snap->changed[channel / 64] |= uint64_t(1) << (channel % 64);
+                    }
+                    storeValue(*snap, channel, scratch_[i]);
+                }
             }
-            LOG_TRACE("wrote %s\n", channels_[i].channelName.c_str());
         }
     }
-    
-    // Finish off the write
-    for (auto& io : ios) {
-        if (!io->endWrite()) {
+
+    if (!snap)
+        return false;
+    snap->sequence = ++sequence_;
+    last_ = std::move(snap);
+    return changed;
+}
+
+/**
+ * Capture all data and hand it to all registered I/O backends
+ * Backends with a writer thread are written asynchronously; this only holds the data source locks for the capture itself
+ * \param force Write even if the set is not in SM_Periodic mode and nothing changed
+ */
+bool SaveContext::save(bool force)
+{
+    lastStatus_ = 0;
+
+    const size_t growth = pvsave::captureBufferGrowth();
+    // Deadbands only decide whether on-change sets write. Periodic and forced saves write current values
+    const bool writeAll = force || monitorSet_->mode == SM_Periodic;
+    bool changed = subscribed_ ? captureDirty(writeAll) : captureAll(writeAll);
+    lastCycleGrowth_ = pvsave::captureBufferGrowth() - growth;
+    totalGrowth_ += lastCycleGrowth_;
+
+    if (changed)
+        epicsTimeGetCurrent(&lastChanged_);
+
+    if (!changed && !force && monitorSet_->mode != SM_Periodic) {
+        LOG_DBG("pvSave: %s unchanged, skipping write\n", monitorSet_->name.c_str());
+        return true;
+    }
+
+    for (size_t n = 0; n < monitorSet_->io.size(); ++n) {
+        auto* io = monitorSet_->io[n];
+        if (!(io->flags() & pvsave::SaveRestoreIO::Write))
+            continue;
+
+        if (auto* writer = pvsave::WriterThread::find(io)) {
+            writer->queue(last_, 1u << epicsMin<size_t>(n, 31));
+        }
+        // No writer before iocInit completes, write in-line
+        else if (!pvsave::WriterThread::writeSnapshot(io, *last_)) {
             lastStatus_ = 1;
-            LOG_ERR("pvSave: io->endWrite: save failed\n");
         }
     }
 
@@ -210,9 +464,9 @@ bool SaveContext::save()
 }
 
 /**
- * Restore data from an I/O backend
+ * Stream data from an I/O backend into the sink
  */
-bool SaveContext::restore(pvsave::SaveRestoreIO* io)
+bool SaveContext::read(pvsave::SaveRestoreIO* io, pvsave::RestoreSink& sink)
 {
     if (!(io->flags() & pvsave::SaveRestoreIO::Read))
         return false;
@@ -224,24 +478,80 @@ bool SaveContext::restore(pvsave::SaveRestoreIO* io)
         return false;
     }
 
-    std::unordered_map<std::string, pvsave::Data> pvs;
-    if (!io->readData(pvs)) {
-        LOG_ERR("pvSave: io->readData: restore failed\n");
-        // Fallthrough to allow cleanup
+    // A failed read lets the caller move on to the next backend, once the transaction is cleaned up
+    const bool ok = io->readStream(sink);
+    if (!ok) {
+        LOG_ERR("pvSave: io->readStream: restore failed\n");
     }
 
     if (!io->endRead()) {
         LOG_ERR("pvSave: io->endRead: restore failed\n");
     }
+    return ok;
+}
 
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        auto it = pvs.find(channels_[i].channelName);
-        if (it == pvs.end()) {
-            continue; // PV not found in save data
+/**
+ * Resolves names from a backend against an index of the set's names.
+ * Files are normally written in channel order, so the slot after the last hit is tried first
+ */
+class SaveContext::ChannelSink : public pvsave::RestoreSink
+{
+public:
+    ChannelSink(const pvsave::ChannelIndex& index) : index_(index) {}
+
+    void onData(const char* name, size_t nameLen, const pvsave::Data& value) override
+    {
+        size_t i = resolve(name, nameLen);
+        if (i != UNKNOWN)
+            onResolved(i, name, nameLen, value);
+    }
+
+    size_t resolve(const char* name, size_t nameLen) override
+    {
+        size_t i = index_.find(name, nameLen, next_);
+        if (i == pvsave::ChannelIndex::npos) {
+            ++unknown_;
+            LOG_TRACE("pvSave: %.*s is not in the monitor set\n", (int)nameLen, name);
+            return UNKNOWN;
         }
-        pvsave::dataSource()->put(channels_[i], it->second);
+        next_ = i + 1;
+        return i;
+    }
+
+    void onResolved(size_t channel, const char* name, size_t nameLen, const pvsave::Data& value) override
+    {
+        ++restored_;
+        onChannel(channel, value);
     }
 
+    virtual void onChannel(size_t index, const pvsave::Data& value) = 0;
+
+    const pvsave::ChannelIndex& index_;
+    size_t next_ = 0;
+    size_t restored_ = 0;
+    size_t unknown_ = 0;
+};
+
+/**
+ * Restore data from an I/O backend
+ */
+bool SaveContext::restore(pvsave::SaveRestoreIO* io)
+{
+    // Put each channel as the backend parses it, so the save file is never held in memory
+    class PutSink : public ChannelSink {
+    public:
+        PutSink(const SaveContext& context) : ChannelSink(context.index_), channels_(context.channels_) {}
+        void onChannel(size_t index, const pvsave::Data& value) override {
+            pvsave::dataSource()->put(channels_[index], value);
+        }
+        const std::vector<pvsave::DataSource::Channel>& channels_;
+    } sink(*this);
+
+    if (!read(io, sink))
+        return false;
+
+    LOG_INFO("pvSave: %s: restored %zu of %zu channels, %zu not in set\n", monitorSet_->name.c_str(),
+        sink.restored_, channels_.size(), sink.unknown_);
     return true;
 }
 
@@ -265,6 +575,106 @@ bool SaveContext::restore()
     return true;
 }
 
+/**
+ * Prepare for parseRestore(). Must be called on the init thread before the parse is queued
+ */
+void SaveContext::beginParse()
+{
+    pvIndex_.build(monitorSet_->pvList);
+    parsed_.reset(new epicsEvent());
+}
+
+/**
+ * First half of a buffered restore: read the first usable backend into restoreBuf_ without touching any records.
+ * Save data is matched against the PV list rather than channels_, so this can run before the channels are connected.
+ * Safe to run on a worker thread, as long as no other thread is reading from the same backends. Signals parsed_ when done
+ */
+bool SaveContext::parseRestore()
+{
+    class BufferSink : public ChannelSink {
+    public:
+        BufferSink(SaveContext& context) : ChannelSink(context.pvIndex_), buf_(context.restoreBuf_), found_(context.restoreFound_) {}
+        void onChannel(size_t index, const pvsave::Data& value) override {
+            buf_[index] = value;
+            found_[index] = 1;
+        }
+        std::vector<pvsave::Data>& buf_;
+        std::vector<uint8_t>& found_;
+    };
+
+    const epicsUInt64 start = epicsMonotonicGet();
+    restoreBuf_.resize(monitorSet_->pvList.size());
+    restoreFound_.assign(monitorSet_->pvList.size(), 0);
+
+    bool ok = false;
+    for (auto& io : monitorSet_->io) {
+        // Drop anything a failed backend delivered before giving up
+        std::fill(restoreFound_.begin(), restoreFound_.end(), 0);
+        BufferSink sink(*this);
+        if (read(io, sink)) {
+            LOG_INFO("pvSave: %s: parsed %zu of %zu PVs, %zu not in set\n", monitorSet_->name.c_str(),
+                sink.restored_, monitorSet_->pvList.size(), sink.unknown_);
+            ok = true;
+            break;
+        }
+    }
+
+    if (!ok)
+        LOG_ERR("%s: restore failed: no backend was able to restore\n", "SaveContext::parseRestore");
+
+    parseTime_ = (epicsMonotonicGet() - start) / 1e9;
+    parsed_->signal();
+    return ok;
+}
+
+/**
+ * Second half of a buffered restore: wait for parseRestore() to finish, put everything it found and release the buffers
+ */
+void SaveContext::applyRestore()
+{
+    const epicsUInt64 start = epicsMonotonicGet();
+    parsed_->wait();
+    const double waited = (epicsMonotonicGet() - start) / 1e9;
+
+    // Put in channel order, so runs of found channels keep the batching that group() set up
+    std::vector<pvsave::Data> values(channels_.size());
+    std::vector<uint8_t> found(channels_.size(), 0);
+    size_t hint = 0;
+    for (size_t i = 0; i < channels_.size(); ++i) {
+        auto& name = channels_[i].channelName;
+        size_t pos = pvIndex_.find(name.data(), name.size(), hint);
+        if (pos == pvsave::ChannelIndex::npos)
+            continue;
+        hint = pos + 1;
+        if (restoreFound_[pos]) {
+            values[i] = std::move(restoreBuf_[pos]);
+            found[i] = 1;
+            restoreFound_[pos] = 0; // Duplicate PVs only need restoring once
+        }
+    }
+
+    for (size_t i = 0; i < found.size();) {
+        if (!found[i]) {
+            ++i;
+            continue;
+        }
+        size_t end = i;
+        while (end < found.size() && found[end])
+            ++end;
+        pvsave::dataSource()->putMany(&channels_[i], &values[i], end - i);
+        i = end;
+    }
+
+    std::vector<pvsave::Data>().swap(restoreBuf_);
+    std::vector<uint8_t>().swap(restoreFound_);
+    pvIndex_ = pvsave::ChannelIndex();
+    parsed_.reset();
+
+    restoreTime_ = parseTime_ + (epicsMonotonicGet() - start) / 1e9 - waited;
+    LOG_INFO("pvSave: %s: restore took %.3f s (%.3f s parsing), stage waited %.3f s for it\n", monitorSet_->name.c_str(),
+        restoreTime_, parseTime_, waited);
+}
+
 //-------------------------------------------------------------------------//
 // Utilities
 //-------------------------------------------------------------------------//
@@ -280,17 +690,42 @@ epicsTimeStamp pvsave::lastProcTime(int ms)
     }
 }
 
+epicsTimeStamp pvsave::lastChangedTime(int ms)
+{
+    if (ms < 0) {
+        return s_lastChangedTime;
+    } else if ((size_t)ms < SaveContext::saveContexts.size()) {
+        return SaveContext::saveContexts[ms].lastChanged_;
+    } else {
+        return {};
+    }
+}
+
 int pvsave::lastStatus(int ms)
 {
     if (ms < 0) {
-        return s_lastStatus;
+        // Writes complete asynchronously, so fold in the per-context write results too
+        int status = s_lastStatus;
+        for (auto& context : SaveContext::saveContexts)
+            status |= context.status();
+        return status;
     } else if ((size_t)ms < SaveContext::saveContexts.size()) {
-        return SaveContext::saveContexts[ms].lastStatus_;
+        return SaveContext::saveContexts[ms].status();
     } else {
         return 0;
     }
 }
 
+/**
+ * Roll a context's timestamps into the ones reported for "any monitor set"
+ */
+static void updateGlobalTimes(const SaveContext& context)
+{
+    s_lastProcTime = context.lastProc_;
+    if (epicsTimeDiffInSeconds(&context.lastChanged_, &s_lastChangedTime) > 0)
+        s_lastChangedTime = context.lastChanged_;
+}
+
 void pvsave::saveAllNow()
 {
     epicsGuard<epicsMutex> guard(contextGuard());
@@ -300,11 +735,12 @@ void pvsave::saveAllNow()
 
     s_lastStatus = 0;
     for (auto& context : SaveContext::saveContexts) {
-        if (!context.save()) {
+        if (!context.save(true)) {
             s_lastStatus = 1;
             LOG_ERR("Unable to save!\n");
         }
         context.lastProc_ = now;
+        updateGlobalTimes(context);
     }
 
     // Kick off I/O scan for status records
@@ -434,38 +870,72 @@ static void tokenizeAndAdd(const char* recName, const char* fields, std::vector<
 // Thread proc
 //-------------------------------------------------------------------------//
 
+/**
+ * \brief Entry in the save schedule. Ordered so that std::priority_queue yields the earliest deadline first,
+ * and among equal deadlines the highest priority first
+ */
+struct ScheduleEntry {
+    epicsUInt64 deadline;   // epicsMonotonicGet() time, in ns
+    int priority;
+    size_t context;         // Index into SaveContext::saveContexts
+
+    bool operator<(const ScheduleEntry& other) const
+    {
+        if (deadline != other.deadline)
+            return deadline > other.deadline;
+        return priority < other.priority;
+    }
+};
+
 static void pvSaveThreadProc(void* data)
 {
-    epicsTimeStamp startTime;
-    epicsTimeGetCurrent(&startTime);
+    constexpr double NS_PER_SEC = 1e9;
 
-    double sleepTime = 30.f;
-    for (auto& context : SaveContext::saveContexts)
-        sleepTime = epicsMin(context.monitorSet()->period, sleepTime);
+    std::vector<ScheduleEntry> storage;
+    storage.reserve(SaveContext::saveContexts.size());
+    std::priority_queue<ScheduleEntry> schedule(std::less<ScheduleEntry>(), std::move(storage));
 
-    while (1) {
-        epicsThreadSleep(sleepTime);
-        sleepTime = 30.f;
+    // First save of each set is one period (plus its phase offset) after startup
+    const epicsUInt64 start = epicsMonotonicGet();
+    for (size_t i = 0; i < SaveContext::saveContexts.size(); ++i) {
+        auto& ms = SaveContext::saveContexts[i].monitorSet();
+        schedule.push({start + epicsUInt64((ms->period + ms->phase) * NS_PER_SEC), ms->priority, i});
+    }
 
-        epicsTimeStamp now;
-        epicsTimeGetCurrent(&now);
+    while (!schedule.empty()) {
+        epicsUInt64 now = epicsMonotonicGet();
+        if (schedule.top().deadline > now) {
+            epicsThreadSleep((schedule.top().deadline - now) / NS_PER_SEC);
+            continue;
+        }
 
-        epicsGuard<epicsMutex> guard(contextGuard());
+        // Run everything that is due, earliest deadline (then highest priority) first
         s_lastStatus = 0;
-        for (auto& context : SaveContext::saveContexts) {
-            double diff;
-            if ((diff = epicsTimeDiffInSeconds(&now, &context.lastProc_)) < context.monitorSet()->period) {
-                // Compute how long we should sleep for next iteration. This isn't going to be perfect though
-                sleepTime = epicsMin(diff, sleepTime);
-                continue;
+        while (!schedule.empty() && schedule.top().deadline <= now) {
+            ScheduleEntry entry = schedule.top();
+            schedule.pop();
+
+            auto& context = SaveContext::saveContexts[entry.context];
+            {
+                epicsGuard<epicsMutex> guard(contextGuard());
+                epicsTimeGetCurrent(&context.lastProc_);
+                if (!context.save()) {
+                    LOG_ERR("pvSave: save failed\n");
+                    s_lastStatus = 1;
+                }
+                updateGlobalTimes(context);
             }
 
-            if (!context.save()) {
-                LOG_ERR("pvSave: save failed\n");
-                s_lastStatus = 1;
+            // Next deadline is relative to the previous one, not to when we woke up, so periods don't drift.
+            // If we fell behind by more than a period, skip the missed ones instead of saving back-to-back
+            const epicsUInt64 period = epicsUInt64(context.monitorSet()->period * NS_PER_SEC);
+            entry.deadline += period;
+            if (entry.deadline <= now) {
+                epicsUInt64 missed = (now - entry.deadline) / period + 1;
+                LOG_WARN("pvSave: %s: save overran, skipping %llu period(s)\n", context.monitorSet()->name.c_str(), (unsigned long long)missed);
+                entry.deadline += missed * period;
             }
-            context.lastProc_ = now;
-            sleepTime = epicsMin(sleepTime, context.monitorSet()->period);
+            schedule.push(entry);
         }
 
         // Kick off I/O scan for status records
@@ -473,13 +943,168 @@ static void pvSaveThreadProc(void* data)
     }
 }
 
+/**
+ * Contexts parsed by one pool job. Sets that share a backend go in the same job, backends aren't thread safe
+ */
+struct RestoreJob {
+    std::vector<SaveContext*> contexts;
+    epicsJob* handle;
+};
+
+static epicsThreadPool* s_restorePool = nullptr;
+static std::vector<RestoreJob> s_restoreJobs;    // Referenced by queued jobs, must not change while the pool exists
+
+static bool sharesBackend(const RestoreJob& job, const SaveContext& context)
+{
+    for (auto* other : job.contexts) {
+        for (auto* io : other->monitorSet()->io) {
+            if (std::find(context.monitorSet()->io.begin(), context.monitorSet()->io.end(), io) != context.monitorSet()->io.end())
+                return true;
+        }
+    }
+    return false;
+}
+
+static void restoreJobFunc(void* arg, epicsJobMode mode)
+{
+    if (mode != epicsJobModeRun)
+        return;
+    for (auto* context : static_cast<RestoreJob*>(arg)->contexts)
+        context->parseRestore();
+}
+
+/**
+ * Start parsing the save data of every set restored at the given stage, or at any stage if state is initHookAtIocBuild.
+ * Parsing runs on a thread pool; restoreStage() waits for each set's parse to finish before putting its values
+ */
+static void startParse(initHookState state)
+{
+    std::vector<RestoreJob> jobs;
+    for (auto& context : SaveContext::saveContexts) {
+        const int stage = context.monitorSet()->stage;
+        if (stage < 0 || (state != initHookAtIocBuild && stage != state))
+            continue;
+
+        RestoreJob* target = nullptr;
+        for (size_t i = 0; i < jobs.size();) {
+            if (!sharesBackend(jobs[i], context)) {
+                ++i;
+                continue;
+            }
+            if (!target) {
+                target = &jobs[i++];
+                continue;
+            }
+            // context links two jobs together, merge them. Erasing after target leaves it valid
+            target->contexts.insert(target->contexts.end(), jobs[i].contexts.begin(), jobs[i].contexts.end());
+            jobs.erase(jobs.begin() + i);
+        }
+        if (target)
+            target->contexts.push_back(&context);
+        else
+            jobs.push_back({{&context}, nullptr});
+    }
+
+    if (jobs.empty())
+        return;
+
+    // Parse in the order the stages will need the data. The pool runs jobs in queue order
+    auto byStage = [](const SaveContext* a, const SaveContext* b) { return a->monitorSet()->stage < b->monitorSet()->stage; };
+    for (auto& job : jobs)
+        std::stable_sort(job.contexts.begin(), job.contexts.end(), byStage);
+    std::stable_sort(jobs.begin(), jobs.end(), [&](const RestoreJob& a, const RestoreJob& b) {
+        return byStage(a.contexts.front(), b.contexts.front());
+    });
+
+    epicsThreadPoolConfig conf;
+    epicsThreadPoolConfigDefaults(&conf);
+    conf.maxThreads = epicsMin(size_t(epicsMax(s_restoreThreads, 1)), jobs.size());
+    conf.initialThreads = conf.maxThreads;
+    conf.workerPriority = s_configuredThreadPriority;
+    conf.workerStack = epicsThreadGetStackSize(epicsThreadStackMedium);
+    if (!(s_restorePool = epicsThreadPoolCreate(&conf))) {
+        LOG_WARN("pvSave: unable to create restore thread pool, restoring serially\n");
+        return;
+    }
+
+    s_restoreJobs = std::move(jobs);
+    for (auto& job : s_restoreJobs) {
+        for (auto* context : job.contexts)
+            context->beginParse();
+        job.handle = epicsJobCreate(s_restorePool, restoreJobFunc, &job);
+        if (!job.handle || epicsJobQueue(job.handle) != 0) {
+            // Still have to restore these sets, do it here
+            LOG_WARN("pvSave: unable to queue restore job, parsing on the init thread\n");
+            restoreJobFunc(&job, epicsJobModeRun);
+        }
+    }
+}
+
+/**
+ * Tear down the pool created by startParse(). All parses must have been applied
+ */
+static void stopParse()
+{
+    if (!s_restorePool)
+        return;
+    epicsThreadPoolWait(s_restorePool, -1);
+    for (auto& job : s_restoreJobs) {
+        if (job.handle)
+            epicsJobDestroy(job.handle);
+    }
+    epicsThreadPoolDestroy(s_restorePool);
+    s_restorePool = nullptr;
+    std::vector<RestoreJob>().swap(s_restoreJobs);
+}
+
+/**
+ * Restore every set configured for this init stage.
+ * Sets whose save data was parsed by startParse() have their buffered values put here, on this thread and in set order,
+ * so record access looks the same as a serial restore. Everything else is streamed straight from the backend
+ */
+static void restoreStage(initHookState state)
+{
+    if (!s_restorePool && s_restoreThreads > 1)
+        startParse(state);
+
+    const epicsUInt64 stageStart = epicsMonotonicGet();
+    size_t numSets = 0;
+    for (auto& context : SaveContext::saveContexts) {
+        if (context.monitorSet()->stage != state)
+            continue;
+        ++numSets;
+
+        if (context.parsing()) {
+            context.applyRestore();
+            continue;
+        }
+
+        const epicsUInt64 start = epicsMonotonicGet();
+        context.restore();
+        context.restoreTime_ = (epicsMonotonicGet() - start) / 1e9;
+        LOG_INFO("pvSave: %s: restore took %.3f s\n", context.monitorSet()->name.c_str(), context.restoreTime_);
+    }
+
+    if (numSets)
+        LOG_INFO("pvSave: restored %zu sets in %.3f s\n", numSets, (epicsMonotonicGet() - stageStart) / 1e9);
+
+    if (!s_restorePrefetch || state == initHookAfterIocRunning)
+        stopParse();
+}
+
 void pvsInitHook(initHookState state)
 {
     // Create the contexts and init everything else
     if (state == initHookAtIocBuild) {
+        // Contexts hand out pointers to themselves, so the vector must never reallocate
+        SaveContext::saveContexts.reserve(monitorSets.size());
         for (auto& ms : monitorSets) {
             SaveContext::saveContexts.emplace_back(ms.second);
         }
+
+        // Get file I/O and parsing out of the way while the rest of iocInit runs
+        if (s_restorePrefetch)
+            startParse(state);
     }
     // Kick off discovery of PVs
     else if (state == initHookAfterInitDevSup) {
@@ -488,28 +1113,36 @@ void pvsInitHook(initHookState state)
             context.init();
 
         // Pass 0 restore
-        for (auto& context : SaveContext::saveContexts) {
-            if (context.monitorSet()->stage == state)
-                context.restore();
-        }
+        restoreStage(state);
     } else if (state == initHookAfterInitDatabase) {
+        for (auto& context : SaveContext::saveContexts)
+            context.group();
+
         // Pass 1 restore
-        for (auto& context : SaveContext::saveContexts) {
-            if (context.monitorSet()->stage == state)
-                context.restore();
-        }
+        restoreStage(state);
     } else if (state == initHookAfterIocRunning) {
         // Pass 2 restore
+        restoreStage(state);
+
+        // Subscribe only after all restores, so the restores themselves don't count as changes
+        for (auto& context : SaveContext::saveContexts)
+            context.subscribe();
+
+        // One writer thread per backend, sized for the number of sets writing to it
+        std::vector<pvsave::SaveRestoreIO*> ios;
         for (auto& context : SaveContext::saveContexts) {
-            if (context.monitorSet()->stage == state)
-                context.restore();
+            for (auto* io : context.monitorSet()->io) {
+                if (io->flags() & pvsave::SaveRestoreIO::Write)
+                    ios.push_back(io);
+            }
         }
+        pvsave::WriterThread::startAll(ios, s_configuredThreadPriority);
 
         epicsThreadOpts opts;
         opts.joinable = false;
         opts.priority = s_configuredThreadPriority;
         opts.stackSize = epicsThreadStackMedium;
-        epicsThreadCreateOpt("pvSave", pvSaveThreadProc, nullptr, &opts);
+        s_threadId = epicsThreadCreateOpt("pvSave", pvSaveThreadProc, nullptr, &opts);
     }
 }
 
@@ -666,14 +1299,124 @@ static void pvSave_SetPvSetRestoreStageCallFunc(const iocshArgBuf* buf)
     }
 }
 
+static void pvSave_SetPvSetModeCallFunc(const iocshArgBuf* buf)
+{
+    constexpr const char* funcName = "pvSave_SetPvSetMode";
+    const char* name = buf[0].sval;
+    const char* mode = buf[1].sval;
+
+    if (!name || !mode) {
+        printf("%s: expected 'name' and 'mode' parameter\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    auto mset = findMonitorSet(name);
+    if (!mset) {
+        printf("%s: invalid monitor set name '%s'\n", funcName, name);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (!epicsStrCaseCmp(mode, "periodic")) {
+        mset->mode = SM_Periodic;
+    } else if (!epicsStrCaseCmp(mode, "onChange")) {
+        mset->mode = SM_OnChange;
+    } else if (!epicsStrCaseCmp(mode, "event")) {
+        mset->mode = SM_Event;
+    } else {
+        printf("%s: invalid mode '%s': 'periodic', 'onChange' or 'event' allowed\n", funcName, mode);
+        iocshSetError(-1);
+    }
+}
+
+static void pvSave_SetPvSetScheduleCallFunc(const iocshArgBuf* buf)
+{
+    constexpr const char* funcName = "pvSave_SetPvSetSchedule";
+    const char* name = buf[0].sval;
+    int priority = buf[1].ival;
+    double phase = buf[2].dval;
+
+    if (!name) {
+        printf("%s: expected 'name' parameter\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (s_threadId) {
+        printf("%s: thread is already created; this function must be called before iocInit!\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    auto mset = findMonitorSet(name);
+    if (!mset) {
+        printf("%s: invalid monitor set name '%s'\n", funcName, name);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (phase < 0 || phase >= mset->period) {
+        printf("%s: phase must be >= 0 and less than the period (%f)\n", funcName, mset->period);
+        iocshSetError(-1);
+        return;
+    }
+
+    mset->priority = priority;
+    mset->phase = phase;
+}
+
+static void pvSave_SetPvDeadbandCallFunc(const iocshArgBuf* buf)
+{
+    constexpr const char* funcName = "pvSave_SetPvDeadband";
+    const char* name = buf[0].sval;
+    const char* pvName = buf[1].sval;
+    double deadband = buf[2].dval;
+
+    if (!name || !pvName) {
+        printf("%s: expected 'name' and 'pvName' parameter\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (s_threadId) {
+        printf("%s: thread is already created; this function must be called before iocInit!\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    auto mset = findMonitorSet(name);
+    if (!mset) {
+        printf("%s: invalid monitor set name '%s'\n", funcName, name);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (!(deadband >= 0)) {
+        printf("%s: deadband must be >= 0\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    mset->deadbands[pvName] = deadband;
+}
+
 static void pvSave_ListPvSetsCallFunc(const iocshArgBuf* buf)
 {
     for (auto& pair : monitorSets) {
         printf("%s: %lu PVs\n", pair.first.c_str(), pair.second->pvList.size());
+        printf("  period: %.2f s, phase: %.2f s, priority: %d\n", pair.second->period, pair.second->phase, pair.second->priority);
+        if (auto* ctx = pair.second->context) {
+            printf("  capture buffer growth: %zu last cycle, %zu total\n", ctx->lastCycleGrowth_, ctx->totalGrowth_);
+            printf("  last restore: %.3f s\n", ctx->restoreTime_);
+            printf("  snapshot size: %zu bytes\n", ctx->snapshotBytes_);
+        }
         printf("  IO ports:\n");
         for (size_t i = 0; i < pair.second->io.size(); ++i) {
             printf("   %zu:\n", i);
             pair.second->io[i]->report(stdout, 5);
+            if (auto* writer = pvsave::WriterThread::find(pair.second->io[i]))
+                writer->report(stdout, 5);
         }
     }
 }
@@ -738,6 +1481,39 @@ static void pvSave_SetThreadPriorityCallFunc(const iocshArgBuf* buf)
     }
 }
 
+static void pvSave_SetRestoreThreadsCallFunc(const iocshArgBuf* buf)
+{
+    constexpr const char* funcName = "pvSave_SetRestoreThreads";
+    int threads = buf[0].ival;
+
+    if (s_threadId) {
+        printf("%s: restore has already happened; this function must be called before iocInit!\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    if (threads < 0) {
+        printf("%s: numThreads must be >= 0\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    s_restoreThreads = threads;
+}
+
+static void pvSave_SetRestorePrefetchCallFunc(const iocshArgBuf* buf)
+{
+    constexpr const char* funcName = "pvSave_SetRestorePrefetch";
+
+    if (s_threadId) {
+        printf("%s: restore has already happened; this function must be called before iocInit!\n", funcName);
+        iocshSetError(-1);
+        return;
+    }
+
+    s_restorePrefetch = buf[0].ival != 0;
+}
+
 static void pvSave_SaveCallFunc(const iocshArgBuf* buf)
 {
     printf("pvSave: Forcing save...\n");
@@ -848,6 +1624,35 @@ void registerFuncs()
         iocshRegister(&funcDef, pvSave_SetPvSetRestoreStageCallFunc);
     }
 
+    /* pvSave_SetPvSetMode */
+    {
+        static iocshArg arg0 = {"setName", iocshArgString};
+        static iocshArg arg1 = {"mode", iocshArgString};
+        static const iocshArg* args[] = {&arg0, &arg1};
+        static iocshFuncDef funcDef = {"pvSave_SetPvSetMode", 2, args};
+        iocshRegister(&funcDef, pvSave_SetPvSetModeCallFunc);
+    }
+
+    /* pvSave_SetPvSetSchedule */
+    {
+        static iocshArg arg0 = {"setName", iocshArgString};
+        static iocshArg arg1 = {"priority", iocshArgInt};
+        static iocshArg arg2 = {"phase", iocshArgDouble};
+        static const iocshArg* args[] = {&arg0, &arg1, &arg2};
+        static iocshFuncDef funcDef = {"pvSave_SetPvSetSchedule", 3, args};
+        iocshRegister(&funcDef, pvSave_SetPvSetScheduleCallFunc);
+    }
+
+    /* pvSave_SetPvDeadband */
+    {
+        static iocshArg arg0 = {"name", iocshArgString};
+        static iocshArg arg1 = {"pvName", iocshArgString};
+        static iocshArg arg2 = {"deadband", iocshArgDouble};
+        static const iocshArg* args[] = {&arg0, &arg1, &arg2};
+        static iocshFuncDef funcDef = {"pvSave_SetPvDeadband", 3, args};
+        iocshRegister(&funcDef, pvSave_SetPvDeadbandCallFunc);
+    }
+
     /* pvSave_ListChannels */
     {
         static iocshArg arg0 = {"setName", iocshArgString};
@@ -881,6 +1686,22 @@ void registerFuncs()
         iocshRegister(&funcDef, pvSave_SetThreadPriorityCallFunc);
     }
 
+    /* pvSave_SetRestoreThreads */
+    {
+        static iocshArg arg0 = {"numThreads", iocshArgInt};
+        static const iocshArg* args[] = {&arg0};
+        static iocshFuncDef funcDef = {"pvSave_SetRestoreThreads", 1, args};
+        iocshRegister(&funcDef, pvSave_SetRestoreThreadsCallFunc);
+    }
+
+    /* pvSave_SetRestorePrefetch */
+    {
+        static iocshArg arg0 = {"enable", iocshArgInt};
+        static const iocshArg* args[] = {&arg0};
+        static iocshFuncDef funcDef = {"pvSave_SetRestorePrefetch", 1, args};
+        iocshRegister(&funcDef, pvSave_SetRestorePrefetchCallFunc);
+    }
+
     /* pvSave_Save */
     {
         static iocshFuncDef funcDef = {"pvSave_Save", 0, NULL};
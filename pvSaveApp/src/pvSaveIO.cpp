@@ -22,9 +22,23 @@ pvsave::SaveRestoreIO::SaveRestoreIO(const char* instName) :
     pvsave::ioBackends().insert({instName, this});
 }
 
+pvsave::SaveRestoreIO::SaveRestoreIO(const char* instName, Unlisted) :
+    instName_(instName)
+{
+}
+
 pvsave::SaveRestoreIO::~SaveRestoreIO()
 {
     auto it = pvsave::ioBackends().find(instName_);
-    if (it != pvsave::ioBackends().end())
+    if (it != pvsave::ioBackends().end() && it->second == this)
         pvsave::ioBackends().erase(it);
 }
+
+bool pvsave::SaveRestoreIO::readStream(RestoreSink& sink)
+{
+    std::unordered_map<std::string, Data> pvs;
+    bool result = readData(pvs);
+    for (auto& pair : pvs)
+        sink.onData(pair.first.c_str(), pair.first.size(), pair.second);
+    return result;
+}
@@ -0,0 +1,157 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Compact, typed array storage for waveform-like fields.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pvsave/variant.h"
+
+namespace pvsave {
+
+/**
+ * \brief Returns the size of one element of a numeric type code, or 0 for anything else
+ */
+inline size_t elementSize(ETypeCode code) {
+	switch (code) {
+	case ETypeCode::INT8:
+	case ETypeCode::UINT8:
+		return 1;
+	case ETypeCode::INT16:
+	case ETypeCode::UINT16:
+		return 2;
+	case ETypeCode::INT32:
+	case ETypeCode::UINT32:
+	case ETypeCode::FLOAT:
+		return 4;
+	case ETypeCode::INT64:
+	case ETypeCode::UINT64:
+	case ETypeCode::DOUBLE:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * \brief Array of numeric elements, stored as one contiguous buffer
+ * Used for waveforms, aai/aao and long strings (which are char arrays to the database).
+ * The buffer is kept when the array shrinks or changes type, so a slot that is refilled every cycle only allocates when it grows
+ */
+class DataArray {
+public:
+	DataArray() = default;
+
+	DataArray(ETypeCode type, size_t count) {
+		resize(type, count);
+	}
+
+	/**
+	 * \brief Set the element type and count. Contents are unspecified afterwards
+	 * \returns True if the buffer had to grow
+	 */
+	bool resize(ETypeCode type, size_t count) {
+		type_ = type;
+		count_ = count;
+		const size_t words = (count * elementSize(type) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+		if (words <= buf_.size())
+			return false;
+		buf_.resize(words);
+		return true;
+	}
+
+	/**
+	 * \brief Make room for count elements of type, without changing the current size
+	 * \returns True if the buffer had to grow
+	 */
+	bool reserve(ETypeCode type, size_t count) {
+		const size_t words = (count * elementSize(type) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+		if (words <= buf_.size())
+			return false;
+		buf_.resize(words);
+		return true;
+	}
+
+	inline ETypeCode elementType() const { return type_; }
+	inline size_t size() const { return count_; }
+	inline bool empty() const { return count_ == 0; }
+
+	/**
+	 * \brief Returns the size of the contents, in bytes
+	 */
+	inline size_t bytes() const { return count_ * elementSize(type_); }
+
+	/**
+	 * \brief Returns the number of elements the buffer can hold without growing
+	 */
+	inline size_t capacity() const {
+		const size_t es = elementSize(type_);
+		return es ? buf_.size() * sizeof(uint64_t) / es : 0;
+	}
+
+	inline void* data() { return buf_.data(); }
+	inline const void* data() const { return buf_.data(); }
+
+	/**
+	 * \brief Returns the elements as T, or nullptr if T doesn't match the element type
+	 */
+	template<typename T>
+	inline T* as() {
+		return type_code_for<T>() == type_ ? reinterpret_cast<T*>(buf_.data()) : nullptr;
+	}
+
+	template<typename T>
+	inline const T* as() const {
+		return type_code_for<T>() == type_ ? reinterpret_cast<const T*>(buf_.data()) : nullptr;
+	}
+
+	// Copies only what's in use, and reuses our buffer if it's large enough
+	DataArray& operator=(const DataArray& other) {
+		if (this != &other) {
+			resize(other.type_, other.count_);
+			if (other.bytes())
+				std::memcpy(buf_.data(), other.buf_.data(), other.bytes());
+		}
+		return *this;
+	}
+
+	DataArray(const DataArray& other) {
+		*this = other;
+	}
+
+	DataArray(DataArray&& other) = default;
+	DataArray& operator=(DataArray&& other) = default;
+
+	// Bitwise, like the other trivial types held by Data
+	inline bool operator==(const DataArray& other) const {
+		return type_ == other.type_ && count_ == other.count_ && std::memcmp(buf_.data(), other.buf_.data(), bytes()) == 0;
+	}
+
+	inline bool operator!=(const DataArray& other) const {
+		return !(*this == other);
+	}
+
+private:
+	ETypeCode type_ = ETypeCode::VOID;
+	size_t count_ = 0;
+	std::vector<uint64_t> buf_;	// uint64_t keeps every element type aligned
+};
+
+template<> constexpr ETypeCode type_code_for<DataArray>() { return ETypeCode::ARRAY; }
+
+}
@@ -0,0 +1,94 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Fixed-capacity string stored inline, for EPICS string fields.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "pvsave/variant.h"
+
+namespace pvsave {
+
+/**
+ * \brief NUL terminated string of at most N-1 characters, stored inline
+ * Everything after the terminator is kept zeroed, so two strings with the same contents are bitwise equal.
+ * That lets Variant compare and copy it like any other trivial type
+ */
+template<size_t N>
+class FixedString {
+public:
+	static constexpr size_t CAPACITY = N - 1;	// Characters, not counting the terminator
+
+	FixedString() {
+		std::memset(buf_, 0, N);
+	}
+
+	FixedString(const char* str) {
+		assign(str);
+	}
+
+	/**
+	 * \brief Assign from a C string. Anything beyond CAPACITY characters is cut off
+	 * \returns False if the string was truncated
+	 */
+	bool assign(const char* str) {
+		return assign(str, strnlen(str, N));
+	}
+
+	bool assign(const char* str, size_t len) {
+		const bool fits = len <= CAPACITY;
+		if (!fits)
+			len = CAPACITY;
+		std::memcpy(buf_, str, len);
+		std::memset(buf_ + len, 0, N - len);
+		return fits;
+	}
+
+	/**
+	 * \brief Re-establish the zeroed tail after writing to data() directly, e.g. with dbGet
+	 */
+	void normalize() {
+		buf_[CAPACITY] = 0;
+		const size_t len = std::strlen(buf_);
+		std::memset(buf_ + len, 0, N - len);
+	}
+
+	inline const char* c_str() const { return buf_; }
+	inline char* data() { return buf_; }
+	inline size_t size() const { return std::strlen(buf_); }
+	inline bool empty() const { return buf_[0] == 0; }
+
+	inline bool operator==(const FixedString& other) const {
+		return std::memcmp(buf_, other.buf_, N) == 0;
+	}
+
+	inline bool operator!=(const FixedString& other) const {
+		return !(*this == other);
+	}
+
+private:
+	char buf_[N];
+};
+
+/**
+ * \brief Value of a DBF_STRING field. Sized for MAX_STRING_SIZE, including the terminator
+ */
+using DbString = FixedString<40>;
+
+template<> constexpr ETypeCode type_code_for<DbString>() { return ETypeCode::FSTRING; }
+
+}
@@ -15,12 +15,16 @@
  **/
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <stdint.h>
 
 #include "pvsave/variant.h"
+#include "pvsave/dataArray.h"
+#include "pvsave/fixedString.h"
 
 namespace pvsave {
     class SaveRestoreIO;
@@ -56,10 +60,56 @@ namespace pvsave {
         uint64_t,
         float,
         double,
-        std::string
+        std::string,
+        DbString,
+        DataArray
     >;
 
 
+    /**
+     * \brief Tracks which channels of a monitor set changed since they were last read.
+     * Channels are marked dirty by the data source, usually from its own event thread, and consumed by the save thread.
+     */
+    class ChangeTracker {
+    public:
+        /**
+         * \brief Resize the tracker to hold n channels. All channels start out dirty
+         */
+        void resize(size_t n) {
+            words_ = (n + 31) / 32;
+            bits_.reset(new std::atomic<uint32_t>[words_]);
+            for (size_t i = 0; i < words_; ++i)
+                bits_[i] = (i == words_ - 1 && n % 32) ? (1u << (n % 32)) - 1 : ~0u;
+            dirty_ = n > 0;
+        }
+
+        /**
+         * \brief Mark a channel as changed. Safe to call from any thread
+         */
+        void markDirty(size_t index) {
+            bits_[index / 32].fetch_or(1u << (index % 32), std::memory_order_relaxed);
+            dirty_.store(true, std::memory_order_release);
+        }
+
+        /**
+         * \brief Returns true if any channel was marked dirty, and clears the flag.
+         * Call this before consuming the words with takeWord()
+         */
+        bool takeAnyDirty() { return dirty_.exchange(false, std::memory_order_acq_rel); }
+
+        /**
+         * \brief Returns and clears the dirty bits for channels [word*32, word*32+32)
+         */
+        uint32_t takeWord(size_t word) { return bits_[word].exchange(0, std::memory_order_acq_rel); }
+
+        size_t words() const { return words_; }
+
+    private:
+        std::unique_ptr<std::atomic<uint32_t>[]> bits_;
+        size_t words_ = 0;
+        std::atomic<bool> dirty_{false};
+    };
+
     /**
      * Abstract interface implemented by all data sources
      * Data sources provide PV data from an arbitrary backend such as the IOC DB, ChannelAccess or PVXS.
@@ -84,6 +134,19 @@ namespace pvsave {
          */
         virtual void connect(const std::vector<std::string>& pvList, std::vector<Channel>& outChannels) = 0;
 
+        /**
+         * \brief Called once the database is fully initialized, before channels are restored in pass 1 or saved
+         * Data sources may reorder the channels so that getMany/putMany can batch locking more effectively
+         * \param channels Channels returned by connect()
+         */
+        virtual void group(std::vector<Channel>& channels) {}
+
+        /**
+         * \brief Returns the type that get() produces for a channel, or ETypeCode::VOID if it isn't known up front
+         * Used to lay out snapshots; values of known fixed-size types are stored densely by type
+         */
+        virtual ETypeCode channelType(const Channel& channel) const { return ETypeCode::VOID; }
+
         /**
          * Put PV data
          * \param channels List of channels to PUT
@@ -97,10 +160,78 @@ namespace pvsave {
          * \param pvData list to place the data into. Expects a 1:1 mapping of pvList <-> pvData
          */
         virtual void get(const Channel& channel, Data& pvData) = 0;
+
+        /**
+         * \brief Put PV data for a contiguous range of channels
+         * The default implementation calls put() for each channel. Data sources should override this
+         * to amortize locking and dispatch over the whole range
+         * \param channels First channel of the range
+         * \param pvData Data to put, 1:1 with channels
+         * \param count Number of channels in the range
+         */
+        virtual void putMany(const Channel* channels, const Data* pvData, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                put(channels[i], pvData[i]);
+        }
+
+        /**
+         * \brief Get PV data for a contiguous range of channels
+         * The default implementation calls get() for each channel. Data sources should override this
+         * to amortize locking and dispatch over the whole range
+         * \param channels First channel of the range
+         * \param pvData Output slots, 1:1 with channels
+         * \param count Number of channels in the range
+         */
+        virtual void getMany(const Channel* channels, Data* pvData, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                get(channels[i], pvData[i]);
+        }
+
+        /**
+         * \brief Subscribe to value changes of the channels
+         * \param channels Channels returned by connect()
+         * \param tracker Tracker to mark dirty; channels[i] changing marks index i. Must outlive the subscription
+         * \returns False if this data source cannot deliver change events. The caller must poll instead
+         */
+        virtual bool subscribe(const std::vector<Channel>& channels, ChangeTracker& tracker) { return false; }
     };
 
     DataSource* createDataSourceCA();
 
+    /**
+     * \brief Receives channel data from an IO backend as it is read. See SaveRestoreIO::readStream()
+     */
+    class RestoreSink {
+    public:
+        virtual ~RestoreSink() = default;
+
+        /**
+         * \brief Called by the backend for every channel in the save data, in file order
+         * \param name Channel name. Not NUL terminated and only valid for the duration of the call
+         * \param nameLen Length of name
+         * \param value Parsed value. Only valid for the duration of the call
+         */
+        virtual void onData(const char* name, size_t nameLen, const Data& value) = 0;
+
+        /**
+         * \brief Returned by resolve() for channels the sink has no use for
+         */
+        static constexpr size_t UNKNOWN = size_t(-1);
+
+        /**
+         * \brief Look a channel up before its value is parsed
+         * Backends that see the name ahead of the value may call this followed by onResolved() instead of onData(),
+         * and skip parsing the value altogether when UNKNOWN is returned. The default accepts every channel
+         * \returns Handle to pass to onResolved(), or UNKNOWN
+         */
+        virtual size_t resolve(const char* name, size_t nameLen) { return 0; }
+
+        /**
+         * \brief Same as onData(), for a channel resolve() returned channel for
+         */
+        virtual void onResolved(size_t channel, const char* name, size_t nameLen, const Data& value) { onData(name, nameLen, value); }
+    };
+
     /**
     * SaveRestoreIO is the base class for all I/O readers/writers used by pvSave
     * It provides a subset of operations
@@ -122,6 +253,11 @@ namespace pvsave {
              * \brief Supports PV saves
              */
             Write   = (1<<1),
+
+            /**
+             * \brief Can write only the channels that changed since the previous write, see beginDelta()
+             */
+            Delta   = (1<<2),
         };
 
         /**
@@ -135,6 +271,14 @@ namespace pvsave {
         */
         virtual bool beginWrite() = 0;
 
+        /**
+        * \brief Begins a write transaction that only receives the channels that changed since the previous successful write
+        * Only called on backends with the Delta flag. Returning false turns the transaction into a full write with beginWrite(),
+        * which backends can use to periodically compact what they've written
+        * \returns True if writeData() will only be called for the changed channels
+        */
+        virtual bool beginDelta() { return false; }
+
         /** 
          * \brief Writes a single channel's data.
          * \param channel The channel description
@@ -162,6 +306,14 @@ namespace pvsave {
          */
         virtual bool readData(std::unordered_map<std::string, Data>& pvs) = 0;
 
+        /**
+         * \brief Read channel data, pushing each channel into the sink as it's parsed
+         * Backends should override this to avoid building an intermediate map. The default implementation
+         * reads everything with readData() and forwards it
+         * \param sink Receives the channel data
+         */
+        virtual bool readStream(RestoreSink& sink);
+
         /**
         * \brief Ends a read transaction
         * \returns True on success
@@ -181,6 +333,12 @@ namespace pvsave {
         const std::string& instanceName() const { return instName_; }
 
     protected:
+        /**
+         * \brief Tag for backends owned by another backend, which aren't listed in ioBackends()
+         */
+        struct Unlisted {};
+        SaveRestoreIO(const char* instName, Unlisted);
+
         std::string instName_;
     };
 }
\ No newline at end of file
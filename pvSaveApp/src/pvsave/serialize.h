@@ -38,6 +38,11 @@ namespace pvsave {
      */
     dbfType dbTypeFromString(const char* str);
 
+    /**
+     * \brief Same as dbTypeFromString(), for a string that isn't NUL terminated
+     */
+    dbfType dbTypeFromView(const char* str, size_t len);
+
     /**
      * \brief Convert a ETypeCode to string
      */
@@ -48,6 +53,23 @@ namespace pvsave {
      */
     std::pair<bool, ETypeCode> typeCodeFromString(const char* str);
 
+    /**
+     * \brief Same as typeCodeFromString(), for a string that isn't NUL terminated
+     */
+    std::pair<bool, ETypeCode> typeCodeFromView(const char* str, size_t len);
+
+    /**
+     * \brief Returns the type string written for data. Same as typeCodeString() except for arrays, which get "<element type>[]"
+     */
+    const char* dataTypeString(const Data& data);
+
+    /**
+     * \brief Parse an array type string as written by dataTypeString()
+     * \returns The element type, or false if str isn't an array type
+     */
+    std::pair<bool, ETypeCode> arrayTypeCodeFromString(const char* str);
+    std::pair<bool, ETypeCode> arrayTypeCodeFromView(const char* str, size_t len);
+
     const char* parseString(const char* pstr, std::string& out);
 
     /**
@@ -59,6 +81,17 @@ namespace pvsave {
 
     std::pair<bool, Data> dataParseString(const char* pstring, ETypeCode expected);
 
+    /**
+     * \brief Parse a value in place, e.g. straight out of a mapped file
+     * Numbers must span the whole view, apart from surrounding whitespace. Strings are taken as is, without unescaping
+     * \param p Start of the value, need not be NUL terminated. Nothing past len is read
+     * \param len Length of the value
+     * \param expected Type to parse as
+     * \param out Receives the value. If it already holds that type, its storage is reused
+     * \returns True on success. out is cleared on failure
+     */
+    bool dataParseView(const char* p, size_t len, ETypeCode expected, Data& out);
+
     /**
      * \brief Convert data in a variant to string
      * \param data Variant
@@ -67,4 +100,26 @@ namespace pvsave {
      * \returns True to indicate success
      */
     bool dataToString(const Data& data, char* outBuf, size_t bufLen);
+
+    /**
+     * \brief Append an array to a string as "[e0,e1,...]", with no whitespace
+     * \returns False if the element type is not supported
+     */
+    bool arrayToString(const DataArray& arr, std::string& out);
+
+    /**
+     * \brief Parse an array written by arrayToString()
+     * \param pstring String to parse. Anything after the closing ']' is ignored
+     * \param element Element type
+     * \param out Array to parse into. Its buffer is reused
+     * \returns True to indicate success
+     */
+    bool arrayFromString(const char* pstring, ETypeCode element, DataArray& out);
+
+    /**
+     * \brief Same as arrayFromString(), for a string that isn't NUL terminated. The closing ']' must be within the view
+     */
+    bool arrayFromView(const char* pstring, size_t len, ETypeCode element, DataArray& out);
+
+    std::pair<bool, Data> dataParseArrayString(const char* pstring, ETypeCode element);
 }
\ No newline at end of file
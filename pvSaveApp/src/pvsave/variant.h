@@ -19,10 +19,9 @@
 
 #include <cstdint>
 #include <cstddef>
-#include <typeindex>
-#include <typeinfo>
 #include <type_traits>
 #include <cstring>
+#include <new>
 #include <utility>
 #include <string>
 
@@ -40,6 +39,7 @@ enum class ETypeCode : uint16_t {
 	INT8, UINT8, INT16, UINT16,
 	INT32, UINT32, INT64, UINT64,
 	STRING, FLOAT, DOUBLE, POINTER, REFERENCE, CHAR, CSTRING,
+	ARRAY, FSTRING,
 	OTHER,
 };
 
@@ -61,124 +61,113 @@ template<> constexpr ETypeCode type_code_for<double>() { return ETypeCode::DOUBL
 template<> constexpr ETypeCode type_code_for<char>() { return ETypeCode::CHAR; }
 template<> constexpr ETypeCode type_code_for<const char*>() { return ETypeCode::CSTRING; }
 
+namespace detail {
 
-class TypeCode {
-public:
-	
-	TypeCode() = default;
-	TypeCode(const TypeCode& a) {
-		m_code = a.m_code;
-		m_index = a.m_index;
-	}
-
-	template<typename T>
-	static TypeCode from_type() {
-		TypeCode t;
-		t.set<T>();
-		return t;
-	}
-
-	template<typename T>
-	inline void set() {
-		m_index = typeid(T);
-		m_code = type_code_for<T>();
-	}
-
-	inline void set(const std::type_index& index, ETypeCode code) {
-		m_index = index;
-		m_code = code;
-	}
-
-	inline void clear() { set<void>(); }
-
-	inline const std::type_index& type_index() const { return m_index; }
-	inline ETypeCode type_code() const { return m_code; }
+template<typename...Types>
+struct TypeList {};
 
-	template<typename T>
-	inline bool is() const {
-		return m_index == typeid(T);
-	}
+/**
+ * Compile-time properties of a type list, as bitmasks indexed by ETypeCode
+ */
+template<typename...Types>
+struct VariantTraits {
+	static constexpr uint32_t all = 0;
+	static constexpr uint32_t trivial = 0;
+};
 
-	inline bool operator==(const TypeCode& other) const {
-		return other.m_index == m_index;
-	}
+template<typename T, typename...Types>
+struct VariantTraits<T, Types...> {
+	static_assert(type_code_for<T>() != ETypeCode::OTHER, "Variant types need a type_code_for<T>() specialization");
+	static_assert(uint32_t(type_code_for<T>()) < 32, "Type code does not fit in the trait masks");
+	static_assert(std::is_nothrow_move_constructible<T>::value, "Variant types must be nothrow move constructible");
 
-	inline bool operator!=(const TypeCode& other) const {
-		return other.m_index != m_index;
-	}
+	static constexpr uint32_t bit = uint32_t(1) << uint32_t(type_code_for<T>());
+	static_assert(!(VariantTraits<Types...>::all & bit), "Variant types must have distinct type codes");
 
-	inline bool operator==(const std::type_index& other) const {
-		return other == m_index;
-	}
+	static constexpr uint32_t all = bit | VariantTraits<Types...>::all;
+	static constexpr uint32_t trivial = (std::is_trivially_copyable<T>::value ? bit : 0) | VariantTraits<Types...>::trivial;
+};
 
-	inline bool operator!=(const std::type_index& other) const {
-		return other != m_index;
-	}
+/**
+ * Calls f with a null T* for the type T whose type code is code.
+ * The chain of compares is on constants, so compilers turn it into a jump table
+ */
+template<typename F>
+inline void dispatch(ETypeCode, F&&, TypeList<>) {}
 
-private:
-	std::type_index m_index = typeid(void);
-	ETypeCode m_code = type_code_for<void>();
-};
+template<typename F, typename T, typename...Types>
+inline void dispatch(ETypeCode code, F&& f, TypeList<T, Types...>) {
+	if (code == type_code_for<T>())
+		f(static_cast<T*>(nullptr));
+	else
+		dispatch(code, std::forward<F>(f), TypeList<Types...>{});
+}
 
+}
 
 /**
  * Sort-of type-safe union
- * Unlike std::variant, this stores all types (POD or not) in the same buffer
+ * Unlike std::variant, this stores all types (POD or not) in the same buffer.
+ * The only type information kept is the ETypeCode, so every type in the list must map to a distinct code
  */
 template<typename...Types>
 class Variant {
-	enum class ProxyOp {
-		Construct,		// Default construct
-		Destruct,
-		Copy,			// Copy assign
-		Move			// Move assign
-	};
+	using Traits = detail::VariantTraits<Types...>;
+	using List = detail::TypeList<Types...>;
 
-	using ProxyPtr = void(*)(Variant<Types...>* var, ProxyOp op, const void* src);
+	template<typename T>
+	using NotVariant = typename std::enable_if<!std::is_same<typename std::decay<T>::type, Variant>::value>::type;
 
 	static constexpr size_t ALIGNMENT = align_max<Types...>();
 	static constexpr size_t SIZE = size_max<Types...>();
 public:
 
-	enum TypeFlags : uint16_t {
-		Movable = (1<<1),		// has move assignment
-		Trivial = (1<<2),		// Trivial/POD type
-	};
+	Variant() noexcept = default;
 
-	Variant() = default;
-
-	template<class T>
+	template<class T, class = NotVariant<T>>
 	Variant(const T& value) {
 		set(value);
 	}
 
-	Variant(Variant&& other) {
-		*this = other;
+	Variant(const Variant& other) {
+		copy_construct(other);
 	}
 
-	Variant(const Variant& other) {
-		*this = other;
+	Variant(Variant&& other) noexcept {
+		move_construct(other);
 	}
 
 	Variant& operator=(const Variant& other) {
-		copy_from(other, false);
+		if (this == &other)
+			return *this;
+		// Same non-trivial type: assign, so strings and arrays keep their buffers
+		if (m_code == other.m_code && !is_trivial()) {
+			detail::dispatch(m_code, [&](auto* tag) {
+				using T = typename std::remove_pointer<decltype(tag)>::type;
+				*get_unchecked<T>() = *other.template get_unchecked<T>();
+			}, List{});
+			return *this;
+		}
+		destruct();
+		copy_construct(other);
 		return *this;
 	}
 
-	Variant& operator=(Variant&& other) {
-		copy_from(other, true);
-
-		// Avoid duplicate destroys
-		other.m_proxy = nullptr;
-		other.m_flags = 0;
-		other.m_type.clear();
+	/**
+	 * Moved-from variants are left empty
+	 */
+	Variant& operator=(Variant&& other) noexcept {
+		if (this == &other)
+			return *this;
+		destruct();
+		move_construct(other);
 		return *this;
 	}
 
 	/**
 	 * Assign this variant to a new type or value
 	 */
-	template<typename T>
+	template<typename T, class = NotVariant<T>>
 	Variant& operator=(const T& other) {
 		set(other);
 		return *this;
@@ -188,16 +177,38 @@ public:
 		destruct();
 	}
 
-	inline std::type_index typeindex() const { return m_type.type_index(); }
+	/**
+	 * Returns true if both variants hold the same type and an equal value
+	 */
+	inline bool operator==(const Variant& other) const {
+		if (m_code != other.m_code)
+			return false;
+		bool equal = true;
+		detail::dispatch(m_code, [&](auto* tag) {
+			using T = typename std::remove_pointer<decltype(tag)>::type;
+			// Trivial types are compared bitwise, so NaN == NaN and -0.0 != 0.0. This is what you want for change detection
+			if (std::is_trivially_copyable<T>::value)
+				equal = std::memcmp(m_data, other.m_data, sizeof(T)) == 0;
+			else
+				equal = *get_unchecked<T>() == *other.template get_unchecked<T>();
+		}, List{});
+		return equal;
+	}
+
+	inline bool operator!=(const Variant& other) const {
+		return !(*this == other);
+	}
 
 	inline void clear() { destruct(); }
 
 	inline void destruct() {
-		if (m_type == typeid(void))
-			return; // Already destroyed
-		m_proxy(this, ProxyOp::Destruct, nullptr);
-		m_type.set<void>();
-		m_flags = 0;
+		if (!is_trivial()) {
+			detail::dispatch(m_code, [this](auto* tag) {
+				using T = typename std::remove_pointer<decltype(tag)>::type;
+				get_unchecked<T>()->~T();
+			}, List{});
+		}
+		m_code = ETypeCode::VOID;
 	}
 
 	/**
@@ -209,53 +220,21 @@ public:
 	 */
 	template<typename T, typename...A>
 	inline T& construct(A&&... args) {
+		static_assert(contains<T>(), "T is not one of this variant's types");
 		destruct(); // Kill off any previously stored data
-		m_type.set<T>();
-
-		m_flags = 0;
-		if IF_CONSTEXPR (std::is_move_assignable<T>::value)
-			m_flags |= Movable;
-		if IF_CONSTEXPR (std::is_trivial<T>::value)
-			m_flags |= Trivial;
-
-		// Build wrappers around common type-dependent operations. This is so we can call the right methods even when no type is readily available
-		m_proxy = [](Variant<Types...>* v, ProxyOp op, const void* src) {
-			switch(op) {
-			case ProxyOp::Construct:
-				new (v->data()) T;
-				return;
-			case ProxyOp::Destruct:
-				if IF_CONSTEXPR (!std::is_trivial<T>::value)
-					v->get_unchecked<T>()->~T();
-				return;
-			case ProxyOp::Move:
-				if IF_CONSTEXPR (std::is_move_assignable<T>::value) {
-					(*v->get_unchecked<T>()) = std::move(*reinterpret_cast<const T*>(src));
-					return;
-				}
-				else [[fallthrough]];
-			case ProxyOp::Copy:
-				(*v->get_unchecked<T>()) = *reinterpret_cast<const T*>(src);
-				return;
-			}
-		};
-
-		new (m_data) T(args...);
-		return reinterpret_cast<T&>(m_data);
+		new (m_data) T(std::forward<A>(args)...);
+		m_code = type_code_for<T>();
+		return *get_unchecked<T>();
 	}
 
 	template<typename T>
 	inline T* get() {
-		if (m_type == typeid(T))
-			return reinterpret_cast<T*>(m_data);
-		return nullptr;
+		return is<T>() ? get_unchecked<T>() : nullptr;
 	}
 
 	template<typename T>
 	inline const T* get() const {
-		if (m_type == typeid(T))
-			return reinterpret_cast<T*>(m_data);
-		return nullptr;
+		return is<T>() ? get_unchecked<T>() : nullptr;
 	}
 
 	/**
@@ -264,9 +243,9 @@ public:
 	 */
 	template<typename T>
 	inline T value() const {
-		if (m_type != typeid(T))
+		if (!is<T>())
 			return T();
-		return *reinterpret_cast<const T*>(m_data);
+		return *get_unchecked<T>();
 	}
 
 	/**
@@ -275,21 +254,29 @@ public:
 	 */
 	template<typename T>
 	inline void set(const T& value) {
-		if (m_type != typeid(T)) {
-			destruct();
-			construct<T>();
-		}
-		(*get_unchecked<T>()) = value;
+		if (is<T>())
+			*get_unchecked<T>() = value;
+		else
+			construct<T>(value);
 	}
 
 	/**
 	 * Check if the variant's current type is T
-	 * Not constrained to this variant's types
+	 * Types that aren't in this variant's list are never held, so this is always false for them
 	 * \tparam T type to compare against
 	 */
 	template<typename T>
 	inline bool is() const {
-		return m_type.is<T>();
+		return m_code == type_code_for<T>() && (contains<T>() || m_code == ETypeCode::VOID);
+	}
+
+	/**
+	 * Returns true if T is one of this variant's types
+	 */
+	template<typename T>
+	static constexpr bool contains() {
+		return type_code_for<T>() != ETypeCode::OTHER
+			&& (Traits::all & (uint32_t(1) << uint32_t(type_code_for<T>()))) != 0;
 	}
 
 	inline void* data() { return m_data; }
@@ -302,64 +289,54 @@ public:
 	 */
 	inline constexpr size_t data_size() const { return SIZE; }
 
-	inline uint16_t type_flags() const { return m_flags; }
-
 	/**
 	 * \brief Returns the type code of the current item
-	 * This type code isn't necessarily unique and is only defined for common primitive types
 	 * Intended to be used in switch statements to avoid slow cascading if blocks
 	 */
-	inline ETypeCode type_code() const { return m_type.type_code(); }
-
-	/**
-	 * \brief Returns complete type description
-	 */
-	inline const TypeCode& type() const { return m_type; }
+	inline ETypeCode type_code() const { return m_code; }
 
 	/**
-	 * Tests for properties of the current type
+	 * Tests for properties of the current type. Empty counts as trivial
 	 */
-	inline bool is_trivial() const { return !!(m_flags & Trivial); }
-	inline bool is_movable() const { return !!(m_flags & Movable); }
+	inline bool is_trivial() const { return m_code == ETypeCode::VOID || (Traits::trivial & mask()); }
 
 protected:
-	void copy_from(const Variant& other, bool move) {
-        // Can't copy void, we just clear ourselves out
-        if (other.type_code() == ETypeCode::VOID) {
-            clear();
-            return;
-        }
-
-		// Differing typeindex- dispose current, default construct new
-		if (m_type != other.m_type) {
-			destruct();
-			if (!other.is_trivial())
-				other.m_proxy(this, ProxyOp::Construct, nullptr);
-			m_type = other.m_type;
-			m_proxy = other.m_proxy;
+	inline uint32_t mask() const { return uint32_t(1) << uint32_t(m_code); }
+
+	// Both expect this to be empty
+	void copy_construct(const Variant& other) {
+		if (other.is_trivial()) {
+			std::memcpy(m_data, other.m_data, SIZE);
+		} else {
+			detail::dispatch(other.m_code, [&](auto* tag) {
+				using T = typename std::remove_pointer<decltype(tag)>::type;
+				new (m_data) T(*other.template get_unchecked<T>());
+			}, List{});
 		}
-
-		// Invoke copy ctor for non-trivial types
-		if (!other.is_trivial())
-			other.m_proxy(this, move ? ProxyOp::Move : ProxyOp::Copy, const_cast<char*>(other.m_data));
-		else
-			std::memcpy(m_data, other.data(), SIZE); // Use raw memcpy for everything else
-		m_flags = other.m_flags;
-		m_type = other.m_type;
-		m_proxy = other.m_proxy;
+		m_code = other.m_code;
 	}
 
+	void move_construct(Variant& other) noexcept {
+		if (other.is_trivial()) {
+			std::memcpy(m_data, other.m_data, SIZE);
+		} else {
+			detail::dispatch(other.m_code, [&](auto* tag) {
+				using T = typename std::remove_pointer<decltype(tag)>::type;
+				new (m_data) T(std::move(*other.template get_unchecked<T>()));
+			}, List{});
+		}
+		m_code = other.m_code;
+		other.destruct();
+	}
 
 	template<typename T>
 	inline T* get_unchecked() { return reinterpret_cast<T*>(m_data); }
 
-	// Helpers to call the correct class operators
-	ProxyPtr m_proxy = nullptr;
-	
-	uint16_t m_flags = 0;
-	TypeCode m_type = TypeCode::from_type<void>();
+	template<typename T>
+	inline const T* get_unchecked() const { return reinterpret_cast<const T*>(m_data); }
 
 	alignas(ALIGNMENT) char m_data[SIZE];
+	ETypeCode m_code = ETypeCode::VOID;
 };
 
-}
\ No newline at end of file
+}
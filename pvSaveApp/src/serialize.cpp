@@ -14,6 +14,7 @@
  * ----------------------------------------------------------------------------
  **/
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unordered_map>
@@ -23,31 +24,21 @@
 
 #include "pvsave/serialize.h"
 
-template<typename T> int parseValue(const char* str, T* out);
-template<> int parseValue<epicsInt8>(const char* str, epicsInt8* out) { return epicsParseInt8(str, out, 10, nullptr); }
-template<> int parseValue<epicsInt16>(const char* str, epicsInt16* out) { return epicsParseInt16(str, out, 10, nullptr); }
-template<> int parseValue<epicsInt32>(const char* str, epicsInt32* out) { return epicsParseInt32(str, out, 10, nullptr); }
-template<> int parseValue<epicsInt64>(const char* str, epicsInt64* out) { return epicsParseInt64(str, out, 10, nullptr); }
-template<> int parseValue<epicsUInt8>(const char* str, epicsUInt8* out) { return epicsParseUInt8(str, out, 10, nullptr); }
-template<> int parseValue<epicsUInt16>(const char* str, epicsUInt16* out) { return epicsParseUInt16(str, out, 10, nullptr); }
-template<> int parseValue<epicsUInt32>(const char* str, epicsUInt32* out) { return epicsParseUInt32(str, out, 10, nullptr); }
-template<> int parseValue<epicsUInt64>(const char* str, epicsUInt64* out) { return epicsParseUInt64(str, out, 10, nullptr); }
-template<> int parseValue<epicsFloat32>(const char* str, epicsFloat32* out) { return epicsParseFloat32(str, out, nullptr); }
-template<> int parseValue<epicsFloat64>(const char* str, epicsFloat64* out) { return epicsParseFloat64(str, out, nullptr); }
-
-// FIXME: Workaround for conflicting typedefs when epicsUint64 == uint64_t (may be ul, ull depending on arch)
-// Pointer size check works with RTEMS 6 GCC 13.2.0, probably works with older GCCs too.
-#if __SIZEOF_POINTER__ == 8
-template<> int parseValue<uint64_t>(const char* str, uint64_t* out) {
-    *out = strtoul(str, nullptr, 10);
-    return errno;
-}
-
-template<> int parseValue<int64_t>(const char* str, int64_t* out) {
-    *out = strtoul(str, nullptr, 10);
-    return errno;
+#include "numberFormat.h"
+
+/**
+ * Parse a number that must make up the whole view, apart from surrounding whitespace
+ */
+template<typename T>
+static bool parseWhole(const char* p, size_t len, T& out) {
+    const char* end = p + len;
+    const char* q = pvsave::parseNumber(p, end, out);
+    if (!q)
+        return false;
+    while (q < end && isspace((unsigned char)*q))
+        ++q;
+    return q == end;
 }
-#endif
 
 #if HAVE_PVXS
 
@@ -89,27 +80,28 @@ const char *pvsave::ntTypeString(const pvxs::Value &value) {
 
 void pvsave::ntToString(const pvxs::Value &value, char *buf, size_t bufLen) {}
 
-static constexpr struct {
-    const char *tn;
-    pvxs::TypeCode::code_t code;
-} TYPE_NAME_MAPPING[] = {
-    {"int8_t", pvxs::TypeCode::Int8 },
-    {"uint8_t", pvxs::TypeCode::UInt8 },
-    {"int16_t", pvxs::TypeCode::Int16 },
-    {"uint16_t", pvxs::TypeCode::UInt16 },
-    {"int32_t", pvxs::TypeCode::Int32 },
-    {"uint32_t", pvxs::TypeCode::UInt32 },
-    {"int64_t", pvxs::TypeCode::Int64 },
-    {"uint64_t", pvxs::TypeCode::UInt64 },
-    {"float", pvxs::TypeCode::Float32 },
-    {"double", pvxs::TypeCode::Float64 },
-    {"string", pvxs::TypeCode::String },
-};
-
 std::pair<bool, pvxs::TypeCode> pvsave::ntTypeFromString(const char *ptype) {
-    for (auto& p : TYPE_NAME_MAPPING) {
-        if (!strcmp(ptype, p.tn))
-            return {true, pvxs::TypeCode(p.code)};
+    const size_t len = strlen(ptype);
+    // Same names as ETypeCode, except for the floating point types
+    if (len == 5 && !memcmp(ptype, "float", 5))
+        return {true, pvxs::TypeCode::Float32};
+    if (len == 6 && !memcmp(ptype, "double", 6))
+        return {true, pvxs::TypeCode::Float64};
+
+    auto tc = typeCodeFromView(ptype, len);
+    if (tc.first) {
+        switch (tc.second) {
+        case ETypeCode::INT8:   return {true, pvxs::TypeCode::Int8};
+        case ETypeCode::UINT8:  return {true, pvxs::TypeCode::UInt8};
+        case ETypeCode::INT16:  return {true, pvxs::TypeCode::Int16};
+        case ETypeCode::UINT16: return {true, pvxs::TypeCode::UInt16};
+        case ETypeCode::INT32:  return {true, pvxs::TypeCode::Int32};
+        case ETypeCode::UINT32: return {true, pvxs::TypeCode::UInt32};
+        case ETypeCode::INT64:  return {true, pvxs::TypeCode::Int64};
+        case ETypeCode::UINT64: return {true, pvxs::TypeCode::UInt64};
+        case ETypeCode::STRING: return {true, pvxs::TypeCode::String};
+        default: break;
+        }
     }
     return {false, pvxs::TypeCode()};
 }
@@ -119,7 +111,7 @@ std::pair<bool, pvxs::Value> parseNtScalarFromNumericString(const char* pval, pv
     static_assert(std::is_integral<T>::value || std::is_floating_point<T>::value, "Must be integral or floating-point");
 
     T val;
-    if (parseValue(pval, &val) != 0) {
+    if (!parseWhole(pval, strlen(pval), val)) {
         return {false, pvxs::Value{}};
     }
 
@@ -227,28 +219,6 @@ void pvsave::pindent(FILE* fp, int indent) {
         fputc(' ', fp);
 }
 
-static constexpr struct { const char* name; dbfType type; } STR_TO_DBTYPE[] =
-{
-    { "string",    DBF_STRING },
-    { "int8_t",    DBF_CHAR },
-    { "uint8_t",   DBF_UCHAR },
-    { "int16_t",   DBF_SHORT },
-    { "uint16_t",  DBF_USHORT },
-    { "int32_t",   DBF_LONG },
-    { "uint32_t",  DBF_ULONG },
-    { "int64_t",   DBF_INT64 },
-    { "uint64_t",  DBF_UINT64 },
-    { "float32",   DBF_FLOAT },
-    { "float64",   DBF_DOUBLE },
-    { "enum",      DBF_ENUM },
-    { "menu",      DBF_MENU },
-    { "device",    DBF_DEVICE },
-    { "inlnk",     DBF_INLINK },
-    { "outlnk",    DBF_OUTLINK },
-    { "fwdlnk",    DBF_FWDLINK },
-    { "noaccess",  DBF_NOACCESS }
-};
-
 static constexpr const char* DBTYPE_TO_STR[] =
 {
     "string",       /*DBF_STRING*/
@@ -277,11 +247,48 @@ const char* pvsave::dbTypeString(dbfType ftype) {
 }
 
 dbfType pvsave::dbTypeFromString(const char* str) {
-    for (auto& p : STR_TO_DBTYPE) {
-        if (!strcmp(str, p.name))
-            return p.type;
+    return dbTypeFromView(str, strlen(str));
+}
+
+dbfType pvsave::dbTypeFromView(const char* str, size_t len) {
+    // Value types share their names with ETypeCode
+    auto tc = typeCodeFromView(str, len);
+    if (tc.first) {
+        switch (tc.second) {
+        case ETypeCode::STRING: return DBF_STRING;
+        case ETypeCode::INT8:   return DBF_CHAR;
+        case ETypeCode::UINT8:  return DBF_UCHAR;
+        case ETypeCode::INT16:  return DBF_SHORT;
+        case ETypeCode::UINT16: return DBF_USHORT;
+        case ETypeCode::INT32:  return DBF_LONG;
+        case ETypeCode::UINT32: return DBF_ULONG;
+        case ETypeCode::INT64:  return DBF_INT64;
+        case ETypeCode::UINT64: return DBF_UINT64;
+        case ETypeCode::FLOAT:  return DBF_FLOAT;
+        case ETypeCode::DOUBLE: return DBF_DOUBLE;
+        default:                return DBF_NOACCESS;
+        }
     }
-    return DBF_NOACCESS;
+
+    // "noaccess" needn't be matched, it's what unknown names map to anyway
+    const char* name = nullptr;
+    dbfType type = DBF_NOACCESS;
+    switch (len) {
+    case 4:
+        if (str[0] == 'e') { name = "enum"; type = DBF_ENUM; }
+        else { name = "menu"; type = DBF_MENU; }
+        break;
+    case 5:
+        name = "inlnk"; type = DBF_INLINK; break;
+    case 6:
+        switch (str[0]) {
+        case 'd': name = "device"; type = DBF_DEVICE; break;
+        case 'o': name = "outlnk"; type = DBF_OUTLINK; break;
+        case 'f': name = "fwdlnk"; type = DBF_FWDLINK; break;
+        }
+        break;
+    }
+    return name && !memcmp(str, name, len) ? type : DBF_NOACCESS;
 }
 
 static constexpr const char* TYPECODE_TO_STR[] =
@@ -302,6 +309,8 @@ static constexpr const char* TYPECODE_TO_STR[] =
     "",         /*REFERENCE,*/
     "",         /*CHAR,*/
     "",         /*CSTRING,*/
+    "array",    /*ARRAY,*/
+    "string",   /*FSTRING,*/
 	"",         /*OTHER,*/
 };
 
@@ -309,101 +318,346 @@ const char* pvsave::typeCodeString(ETypeCode code) {
 	return TYPECODE_TO_STR[(int)code];
 }
 
-static constexpr struct { const char* ps; pvsave::ETypeCode c; } STR_TO_TYPECODE[] =
+// Arrays are written as their element type with a [] suffix, e.g. "float64[]"
+static constexpr struct { const char* ps; pvsave::ETypeCode c; } ARRAY_TYPE_STR[] =
 {
-	{ "void",     pvsave::ETypeCode::VOID },
-	{ "int8_t",   pvsave::ETypeCode::INT8 },
-    { "uint8_t",  pvsave::ETypeCode::UINT8 },
-    { "int16_t",  pvsave::ETypeCode::INT16 },
-    { "uint16_t", pvsave::ETypeCode::UINT16 },
-	{ "int32_t",  pvsave::ETypeCode::INT32 },
-    { "uint32_t", pvsave::ETypeCode::UINT32 },
-    { "int64_t",  pvsave::ETypeCode::INT64 },
-    { "uint64_t", pvsave::ETypeCode::UINT64 },
-	{ "string",   pvsave::ETypeCode::STRING },
-    { "float32",  pvsave::ETypeCode::FLOAT },
-    { "float64",  pvsave::ETypeCode::DOUBLE },
-    //{ "", /*POINTER,*/ },
-    //{ "", /*REFERENCE,*/ },
-    //{ "", /*CHAR,*/ },
-    //{ "", /*CSTRING,*/ },
-	//{ "", /*OTHER,*/ },
+	{ "int8_t[]",   pvsave::ETypeCode::INT8 },
+    { "uint8_t[]",  pvsave::ETypeCode::UINT8 },
+    { "int16_t[]",  pvsave::ETypeCode::INT16 },
+    { "uint16_t[]", pvsave::ETypeCode::UINT16 },
+	{ "int32_t[]",  pvsave::ETypeCode::INT32 },
+    { "uint32_t[]", pvsave::ETypeCode::UINT32 },
+    { "int64_t[]",  pvsave::ETypeCode::INT64 },
+    { "uint64_t[]", pvsave::ETypeCode::UINT64 },
+    { "float32[]",  pvsave::ETypeCode::FLOAT },
+    { "float64[]",  pvsave::ETypeCode::DOUBLE },
 };
 
-std::pair<bool, pvsave::ETypeCode> pvsave::typeCodeFromString(const char* str) {
-    for (auto& p : STR_TO_TYPECODE) {
-        if (!strcmp(p.ps, str))
-            return {true, p.c};
+const char* pvsave::dataTypeString(const Data& data) {
+    if (auto* arr = data.get<DataArray>()) {
+        for (auto& p : ARRAY_TYPE_STR) {
+            if (p.c == arr->elementType())
+                return p.ps;
+        }
+        return "";
     }
+    return typeCodeString(data.type_code());
+}
+
+std::pair<bool, pvsave::ETypeCode> pvsave::arrayTypeCodeFromView(const char* str, size_t len) {
+    if (len < 3 || str[len - 2] != '[' || str[len - 1] != ']')
+        return {false, ETypeCode::VOID};
+    auto tc = typeCodeFromView(str, len - 2);
+    if (!tc.first || tc.second == ETypeCode::VOID || tc.second == ETypeCode::STRING)
+        return {false, ETypeCode::VOID};
+    return tc;
+}
+
+std::pair<bool, pvsave::ETypeCode> pvsave::arrayTypeCodeFromString(const char* str) {
+    return arrayTypeCodeFromView(str, strlen(str));
+}
+
+/**
+ * Called for every line or key of a save file. Names are told apart by their length and one character,
+ * so a lookup costs a couple of branches and a single compare
+ */
+std::pair<bool, pvsave::ETypeCode> pvsave::typeCodeFromView(const char* str, size_t len) {
+    const char* name = nullptr;
+    ETypeCode code = ETypeCode::VOID;
+    switch (len) {
+    case 4:
+        name = "void"; code = ETypeCode::VOID; break;
+    case 6:
+        if (str[0] == 'i') { name = "int8_t"; code = ETypeCode::INT8; }
+        else { name = "string"; code = ETypeCode::STRING; }
+        break;
+    case 7:
+        switch (str[4]) {
+        case '8': name = "uint8_t"; code = ETypeCode::UINT8; break;
+        case '6': name = "int16_t"; code = ETypeCode::INT16; break;
+        case '2': name = "int32_t"; code = ETypeCode::INT32; break;
+        case '4': name = "int64_t"; code = ETypeCode::INT64; break;
+        case 't':
+            if (str[5] == '3') { name = "float32"; code = ETypeCode::FLOAT; }
+            else { name = "float64"; code = ETypeCode::DOUBLE; }
+            break;
+        }
+        break;
+    case 8:
+        switch (str[5]) {
+        case '6': name = "uint16_t"; code = ETypeCode::UINT16; break;
+        case '2': name = "uint32_t"; code = ETypeCode::UINT32; break;
+        case '4': name = "uint64_t"; code = ETypeCode::UINT64; break;
+        }
+        break;
+    }
+    if (name && !memcmp(str, name, len))
+        return {true, code};
     return {false, ETypeCode::VOID};
 }
 
+std::pair<bool, pvsave::ETypeCode> pvsave::typeCodeFromString(const char* str) {
+    return typeCodeFromView(str, strlen(str));
+}
+
 template<typename T>
-void parseNumericDataFromString(pvsave::Data& out, const char* string) {
-    out.construct<T>();
-    if (parseValue(string, out.get<T>()) != 0) {
-        out.clear();
-    }
+static bool parseNumericView(pvsave::Data& out, const char* p, size_t len) {
+    if (!out.is<T>())
+        out.construct<T>();
+    return parseWhole(p, len, *out.get<T>());
 }
 
-std::pair<bool, pvsave::Data> pvsave::dataParseString(const char* pstring, ETypeCode expected) {
-    Data d;
+bool pvsave::dataParseView(const char* p, size_t len, ETypeCode expected, Data& out) {
+    bool ok = false;
     switch(expected) {
     case ETypeCode::INT8:
-        parseNumericDataFromString<int8_t>(d, pstring); break;
+        ok = parseNumericView<int8_t>(out, p, len); break;
     case ETypeCode::UINT8:
-        parseNumericDataFromString<uint8_t>(d, pstring); break;
+        ok = parseNumericView<uint8_t>(out, p, len); break;
     case ETypeCode::INT16:
-        parseNumericDataFromString<int16_t>(d, pstring); break;
+        ok = parseNumericView<int16_t>(out, p, len); break;
     case ETypeCode::UINT16:
-        parseNumericDataFromString<uint16_t>(d, pstring); break;
+        ok = parseNumericView<uint16_t>(out, p, len); break;
     case ETypeCode::INT32:
-        parseNumericDataFromString<int32_t>(d, pstring); break;
+        ok = parseNumericView<int32_t>(out, p, len); break;
     case ETypeCode::UINT32:
-        parseNumericDataFromString<uint32_t>(d, pstring); break;
+        ok = parseNumericView<uint32_t>(out, p, len); break;
     case ETypeCode::INT64:
-        parseNumericDataFromString<int64_t>(d, pstring); break;
+        ok = parseNumericView<int64_t>(out, p, len); break;
     case ETypeCode::UINT64:
-        parseNumericDataFromString<uint64_t>(d, pstring); break;
+        ok = parseNumericView<uint64_t>(out, p, len); break;
     case ETypeCode::FLOAT:
-        parseNumericDataFromString<float>(d, pstring); break;
+        ok = parseNumericView<float>(out, p, len); break;
     case ETypeCode::DOUBLE:
-        parseNumericDataFromString<double>(d, pstring); break;
+        ok = parseNumericView<double>(out, p, len); break;
     case ETypeCode::STRING:
-        d.construct<std::string>(pstring); break;
+        // Same as dataParseString: inline if it fits an EPICS string
+        if (len <= DbString::CAPACITY && !memchr(p, 0, len)) {
+            if (!out.is<DbString>())
+                out.construct<DbString>();
+            out.get<DbString>()->assign(p, len);
+        }
+        else {
+            if (!out.is<std::string>())
+                out.construct<std::string>();
+            out.get<std::string>()->assign(p, strnlen(p, len));
+        }
+        ok = true;
+        break;
     default: break;
     }
-    return {d.type_code() != ETypeCode::VOID, d};
+    if (!ok)
+        out.clear();
+    return ok;
+}
+
+std::pair<bool, pvsave::Data> pvsave::dataParseString(const char* pstring, ETypeCode expected) {
+    Data d;
+    const bool ok = dataParseView(pstring, strlen(pstring), expected, d);
+    return {ok, d};
+}
+
+/**
+ * Formats a number with the fewest digits that round trip, into p which must have room for NUMBER_BUFFER_SIZE characters
+ */
+template<typename T>
+static size_t formatElement(T value, char* p) {
+    return pvsave::formatInteger(value, p);
+}
+
+template<>
+size_t formatElement<float>(float value, char* p) {
+    return pvsave::formatFloat(value, p);
+}
+
+template<>
+size_t formatElement<double>(double value, char* p) {
+    return pvsave::formatDouble(value, p);
+}
+
+/**
+ * Formats a number into outBuf, if it fits
+ */
+template<typename T>
+static bool formatNumber(T value, char* outBuf, size_t bufLen) {
+    char tmp[pvsave::NUMBER_BUFFER_SIZE];
+    const size_t len = formatElement<T>(value, tmp);
+    if (len >= bufLen)
+        return false;
+    memcpy(outBuf, tmp, len);
+    outBuf[len] = 0;
+    return true;
 }
 
 bool pvsave::dataToString(const Data& data, char* outBuf, size_t bufLen) {
     switch(data.type_code()) {
     case ETypeCode::INT8:
-        snprintf(outBuf, bufLen, "%d", data.value<int8_t>()); break;
+        return formatNumber(data.value<int8_t>(), outBuf, bufLen);
     case ETypeCode::UINT8:
-        snprintf(outBuf, bufLen, "%d", data.value<uint8_t>()); break;
+        return formatNumber(data.value<uint8_t>(), outBuf, bufLen);
     case ETypeCode::INT16:
-        snprintf(outBuf, bufLen, "%d", data.value<int16_t>()); break;
+        return formatNumber(data.value<int16_t>(), outBuf, bufLen);
     case ETypeCode::UINT16:
-        snprintf(outBuf, bufLen, "%d", data.value<uint16_t>()); break;
+        return formatNumber(data.value<uint16_t>(), outBuf, bufLen);
     case ETypeCode::INT32:
-        snprintf(outBuf, bufLen, "%d", data.value<int32_t>()); break;
+        return formatNumber(data.value<int32_t>(), outBuf, bufLen);
     case ETypeCode::UINT32:
-        snprintf(outBuf, bufLen, "%u", data.value<uint32_t>()); break;
+        return formatNumber(data.value<uint32_t>(), outBuf, bufLen);
     case ETypeCode::INT64:
-        snprintf(outBuf, bufLen, "%ld", data.value<int64_t>()); break;
+        return formatNumber(data.value<int64_t>(), outBuf, bufLen);
     case ETypeCode::UINT64:
-        snprintf(outBuf, bufLen, "%lu", data.value<uint64_t>()); break;
+        return formatNumber(data.value<uint64_t>(), outBuf, bufLen);
     case ETypeCode::FLOAT:
-        snprintf(outBuf, bufLen, "%.17g", data.value<float>()); break;
+        return formatNumber(data.value<float>(), outBuf, bufLen);
     case ETypeCode::DOUBLE:
-        snprintf(outBuf, bufLen, "%.17g", data.value<double>()); break;
+        return formatNumber(data.value<double>(), outBuf, bufLen);
     case ETypeCode::STRING:
-        snprintf(outBuf, bufLen, "%s", data.value<std::string>().c_str());
+        snprintf(outBuf, bufLen, "%s", data.get<std::string>()->c_str());
         outBuf[bufLen-1] = 0;
         break;
+    case ETypeCode::FSTRING:
+        snprintf(outBuf, bufLen, "%s", data.get<DbString>()->c_str());
+        break;
+    case ETypeCode::ARRAY:
+    {
+        // Prefer the std::string overload of arrayToString for arrays, they can be much larger than a line
+        std::string str;
+        if (!arrayToString(*data.get<DataArray>(), str) || str.size() >= bufLen)
+            return false;
+        memcpy(outBuf, str.c_str(), str.size() + 1);
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+static void formatArray(const pvsave::DataArray& arr, std::string& out) {
+    const T* elems = arr.as<T>();
+    const size_t n = arr.size();
+
+    // Format into a stack buffer and append in chunks, instead of growing the string once per element
+    char chunk[1024];
+    size_t len = 0;
+    chunk[len++] = '[';
+    for (size_t i = 0; i < n; ++i) {
+        if (len > sizeof(chunk) - 40) {
+            out.append(chunk, len);
+            len = 0;
+        }
+        if (i > 0)
+            chunk[len++] = ',';
+        len += formatElement<T>(elems[i], chunk + len);
+    }
+    chunk[len++] = ']';
+    out.append(chunk, len);
+}
+
+bool pvsave::arrayToString(const DataArray& arr, std::string& out) {
+    out.reserve(out.size() + arr.size() * 4 + 2);
+    switch (arr.elementType()) {
+    case ETypeCode::INT8:
+        formatArray<int8_t>(arr, out); break;
+    case ETypeCode::UINT8:
+        formatArray<uint8_t>(arr, out); break;
+    case ETypeCode::INT16:
+        formatArray<int16_t>(arr, out); break;
+    case ETypeCode::UINT16:
+        formatArray<uint16_t>(arr, out); break;
+    case ETypeCode::INT32:
+        formatArray<int32_t>(arr, out); break;
+    case ETypeCode::UINT32:
+        formatArray<uint32_t>(arr, out); break;
+    case ETypeCode::INT64:
+        formatArray<int64_t>(arr, out); break;
+    case ETypeCode::UINT64:
+        formatArray<uint64_t>(arr, out); break;
+    case ETypeCode::FLOAT:
+        formatArray<float>(arr, out); break;
+    case ETypeCode::DOUBLE:
+        formatArray<double>(arr, out); break;
     default:
         return false;
     }
     return true;
-}
\ No newline at end of file
+}
+
+template<typename T>
+static bool parseArray(const char* p, const char* end, size_t count, pvsave::DataArray& out) {
+    out.resize(pvsave::type_code_for<T>(), count);
+    T* elems = out.as<T>();
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            while (isspace((unsigned char)*p))
+                ++p;
+            if (*p++ != ',')
+                return false;
+        }
+        if (!(p = pvsave::parseNumber(p, end, elems[i])))
+            return false;
+    }
+    while (isspace((unsigned char)*p))
+        ++p;
+    return *p == ']';
+}
+
+bool pvsave::arrayFromString(const char* pstring, ETypeCode element, DataArray& out) {
+    return arrayFromView(pstring, strlen(pstring), element, out);
+}
+
+bool pvsave::arrayFromView(const char* pstring, size_t len, ETypeCode element, DataArray& out) {
+    const char* p = pstring;
+    const char* end = pstring + len;
+    while (p < end && isspace((unsigned char)*p))
+        ++p;
+    if (p == end || *p++ != '[')
+        return false;
+
+    // Size the buffer once up front. Elements can't run past the ']', so parsing stays within the view
+    const char* close = static_cast<const char*>(memchr(p, ']', end - p));
+    if (!close)
+        return false;
+    size_t commas = 0;
+    bool any = false;
+    for (const char* c = p; c < close; ++c) {
+        if (*c == ',')
+            ++commas;
+        else if (!isspace((unsigned char)*c))
+            any = true;
+    }
+    const size_t count = (any || commas) ? commas + 1 : 0;
+
+    switch (element) {
+    case ETypeCode::INT8:
+        return parseArray<int8_t>(p, close, count, out);
+    case ETypeCode::UINT8:
+        return parseArray<uint8_t>(p, close, count, out);
+    case ETypeCode::INT16:
+        return parseArray<int16_t>(p, close, count, out);
+    case ETypeCode::UINT16:
+        return parseArray<uint16_t>(p, close, count, out);
+    case ETypeCode::INT32:
+        return parseArray<int32_t>(p, close, count, out);
+    case ETypeCode::UINT32:
+        return parseArray<uint32_t>(p, close, count, out);
+    case ETypeCode::INT64:
+        return parseArray<int64_t>(p, close, count, out);
+    case ETypeCode::UINT64:
+        return parseArray<uint64_t>(p, close, count, out);
+    case ETypeCode::FLOAT:
+        return parseArray<float>(p, close, count, out);
+    case ETypeCode::DOUBLE:
+        return parseArray<double>(p, close, count, out);
+    default:
+        return false;
+    }
+}
+
+std::pair<bool, pvsave::Data> pvsave::dataParseArrayString(const char* pstring, ETypeCode element) {
+    Data d;
+    if (!arrayFromString(pstring, element, d.construct<DataArray>()))
+        d.clear();
+    return {d.type_code() != ETypeCode::VOID, d};
+}
@@ -0,0 +1,263 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Columnar (structure-of-arrays) storage for monitor set
+ *  snapshots.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "diffKernel.h"
+#include "snapshotColumns.h"
+
+using namespace pvsave;
+
+template<typename T>
+static inline T readCell(const char* p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static inline void loadCell(const char* p, Data& out)
+{
+    out.set(readCell<T>(p));
+}
+
+size_t ColumnLayout::cellSize(ETypeCode type)
+{
+    if (type == ETypeCode::FSTRING)
+        return sizeof(DbString);
+    return elementSize(type);
+}
+
+void ColumnLayout::build(const std::vector<DataSource::Channel>& channels, const std::unordered_map<std::string, double>* deadbands)
+{
+    for (size_t t = 0; t < NUM_TYPES; ++t)
+        rows_[t] = 0;
+
+    cells_.resize(channels.size());
+    for (size_t i = 0; i < channels.size(); ++i) {
+        ETypeCode type = dataSource()->channelType(channels[i]);
+        if (!cellSize(type))
+            type = ETypeCode::VOID;
+        cells_[i] = Cell{type, uint32_t(rows_[size_t(type)]++)};
+    }
+
+    // Lay the dense columns out back to back, each rounded up to whole words
+    words_ = 0;
+    size_t rowBase = 0;
+    for (size_t t = 0; t < NUM_TYPES; ++t) {
+        offsets_[t] = words_ * sizeof(uint64_t);
+        words_ += (rows_[t] * cellSize(ETypeCode(t)) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        rowBase_[t] = rowBase;
+        rowBase += rows_[t];
+    }
+
+    rowChannels_.resize(channels.size());
+    for (size_t i = 0; i < cells_.size(); ++i)
+        rowChannels_[rowBase_[size_t(cells_[i].type)] + cells_[i].row] = uint32_t(i);
+
+    floatDeadbands_.clear();
+    doubleDeadbands_.clear();
+    if (!deadbands || deadbands->empty())
+        return;
+    for (size_t i = 0; i < cells_.size(); ++i) {
+        auto it = deadbands->find(channels[i].channelName);
+        if (it == deadbands->end())
+            continue;
+        if (cells_[i].type == ETypeCode::FLOAT) {
+            floatDeadbands_.resize(rows_[size_t(ETypeCode::FLOAT)], 0.f);
+            floatDeadbands_[cells_[i].row] = float(it->second);
+        }
+        else if (cells_[i].type == ETypeCode::DOUBLE) {
+            doubleDeadbands_.resize(rows_[size_t(ETypeCode::DOUBLE)], 0.);
+            doubleDeadbands_[cells_[i].row] = it->second;
+        }
+        else
+            LOG_WARN("pvSave: deadband of %s ignored, it is not a float or double channel\n", channels[i].channelName.c_str());
+    }
+}
+
+double ColumnLayout::deadband(size_t channel) const
+{
+    const auto& cell = cells_[channel];
+    if (cell.type == ETypeCode::FLOAT && !floatDeadbands_.empty())
+        return floatDeadbands_[cell.row];
+    if (cell.type == ETypeCode::DOUBLE && !doubleDeadbands_.empty())
+        return doubleDeadbands_[cell.row];
+    return 0;
+}
+
+void SnapshotColumns::reset(const ColumnLayout& layout)
+{
+    layout_ = &layout;
+    words_.assign(layout.words(), 0);
+    other_.resize(layout.rows(ETypeCode::VOID));
+}
+
+bool SnapshotColumns::store(size_t channel, const Data& value)
+{
+    const auto& cell = layout_->cell(channel);
+    if (cell.type == ETypeCode::VOID) {
+        other_[cell.row] = value;
+        return true;
+    }
+
+    // Numbers and DbString sit at the start of the variant's buffer
+    char* p = cellPtr(cell);
+    if (value.type_code() != cell.type) {
+        memset(p, 0, ColumnLayout::cellSize(cell.type));
+        return false;
+    }
+    memcpy(p, value.data(), ColumnLayout::cellSize(cell.type));
+    return true;
+}
+
+const Data& SnapshotColumns::load(size_t channel, Data& tmp) const
+{
+    const auto& cell = layout_->cell(channel);
+    const char* p = cellPtr(cell);
+    switch (cell.type) {
+    case ETypeCode::VOID:
+        return other_[cell.row];
+    case ETypeCode::INT8:   loadCell<int8_t>(p, tmp); break;
+    case ETypeCode::UINT8:  loadCell<uint8_t>(p, tmp); break;
+    case ETypeCode::INT16:  loadCell<int16_t>(p, tmp); break;
+    case ETypeCode::UINT16: loadCell<uint16_t>(p, tmp); break;
+    case ETypeCode::INT32:  loadCell<int32_t>(p, tmp); break;
+    case ETypeCode::UINT32: loadCell<uint32_t>(p, tmp); break;
+    case ETypeCode::INT64:  loadCell<int64_t>(p, tmp); break;
+    case ETypeCode::UINT64: loadCell<uint64_t>(p, tmp); break;
+    case ETypeCode::FLOAT:  loadCell<float>(p, tmp); break;
+    case ETypeCode::DOUBLE: loadCell<double>(p, tmp); break;
+    case ETypeCode::FSTRING:
+        tmp.set(*reinterpret_cast<const DbString*>(p));
+        break;
+    default:
+        tmp.clear();
+        break;
+    }
+    return tmp;
+}
+
+bool SnapshotColumns::equals(size_t channel, const Data& value) const
+{
+    const auto& cell = layout_->cell(channel);
+    if (cell.type == ETypeCode::VOID)
+        return other_[cell.row] == value;
+    return value.type_code() == cell.type && memcmp(cellPtr(cell), value.data(), ColumnLayout::cellSize(cell.type)) == 0;
+}
+
+bool SnapshotColumns::changed(size_t channel, const Data& value) const
+{
+    if (equals(channel, value))
+        return false;
+
+    // Same test as the kernels, including NaN never being within the deadband
+    const auto& cell = layout_->cell(channel);
+    if (cell.type == ETypeCode::FLOAT && layout_->floatDeadbands()) {
+        if (auto* v = value.get<float>())
+            return !(fabs(readCell<float>(cellPtr(cell)) - *v) <= layout_->floatDeadbands()[cell.row]);
+    }
+    else if (cell.type == ETypeCode::DOUBLE && layout_->doubleDeadbands()) {
+        if (auto* v = value.get<double>())
+            return !(fabs(readCell<double>(cellPtr(cell)) - *v) <= layout_->doubleDeadbands()[cell.row]);
+    }
+    return true;
+}
+
+size_t SnapshotColumns::diff(const SnapshotColumns& prev, std::vector<uint64_t>& changed, bool deadbands) const
+{
+    changed.assign((layout_->channels() + 63) / 64, 0);
+
+    auto mark = [&](size_t channel) {
+        changed[channel / 64] |= uint64_t(1) << (channel % 64);
+    };
+
+    // Diff each dense column in chunks, so the row bitmap fits on the stack
+    constexpr size_t CHUNK = 4096;
+    uint64_t bits[CHUNK / 64];
+
+    size_t total = 0;
+    for (size_t t = 1; t < ColumnLayout::NUM_TYPES; ++t) {
+        const ETypeCode type = ETypeCode(t);
+        const size_t rows = layout_->rows(type);
+        const size_t size = ColumnLayout::cellSize(type);
+        if (!rows || !size)
+            continue;
+
+        const char* a = reinterpret_cast<const char*>(words_.data()) + layout_->offset(type);
+        const char* b = reinterpret_cast<const char*>(prev.words_.data()) + layout_->offset(type);
+        for (size_t first = 0; first < rows; first += CHUNK) {
+            const size_t n = rows - first < CHUNK ? rows - first : CHUNK;
+            size_t count;
+            if (type == ETypeCode::FLOAT) {
+                const float* db = deadbands ? layout_->floatDeadbands() : nullptr;
+                count = diffDeadband(reinterpret_cast<const float*>(a) + first, reinterpret_cast<const float*>(b) + first,
+                    db ? db + first : nullptr, n, bits);
+            }
+            else if (type == ETypeCode::DOUBLE) {
+                const double* db = deadbands ? layout_->doubleDeadbands() : nullptr;
+                count = diffDeadband(reinterpret_cast<const double*>(a) + first, reinterpret_cast<const double*>(b) + first,
+                    db ? db + first : nullptr, n, bits);
+            }
+            else
+                count = diffBitwise(a + first * size, b + first * size, size, n, bits);
+
+            if (!count)
+                continue;
+            total += count;
+            for (size_t w = 0; w * 64 < n; ++w) {
+                for (uint64_t m = bits[w]; m; m &= m - 1)
+                    mark(layout_->channelOf(type, first + w * 64 + lowestBit(m)));
+            }
+        }
+    }
+
+    for (size_t row = 0; row < other_.size(); ++row) {
+        if (other_[row] != prev.other_[row]) {
+            mark(layout_->channelOf(ETypeCode::VOID, row));
+            ++total;
+        }
+    }
+    return total;
+}
+
+bool SnapshotColumns::operator==(const SnapshotColumns& other) const
+{
+    if (words_.size() != other.words_.size() || other_.size() != other.other_.size())
+        return false;
+    if (!words_.empty() && memcmp(words_.data(), other.words_.data(), words_.size() * sizeof(uint64_t)) != 0)
+        return false;
+    for (size_t i = 0; i < other_.size(); ++i)
+        if (other_[i] != other.other_[i])
+            return false;
+    return true;
+}
+
+size_t SnapshotColumns::memoryUsage() const
+{
+    size_t bytes = words_.capacity() * sizeof(uint64_t) + other_.capacity() * sizeof(Data);
+    for (auto& d : other_) {
+        if (auto* arr = d.get<DataArray>())
+            bytes += arr->capacity() * elementSize(arr->elementType());
+        else if (auto* str = d.get<std::string>())
+            bytes += str->capacity();
+    }
+    return bytes;
+}
@@ -0,0 +1,186 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Columnar (structure-of-arrays) storage for monitor set
+ *  snapshots.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pvsave/pvSave.h"
+
+namespace pvsave
+{
+
+/**
+ * \brief Maps the channels of a monitor set to rows of typed columns.
+ * Channels whose type is fixed-size (numbers and DBF_STRING) get a row in the dense column of that type.
+ * Everything else, like arrays, long strings and channels of unknown type, gets a row in the Data column.
+ * Built once per monitor set from DataSource::channelType(), and shared by all snapshots of the set.
+ * Float and double channels may have a deadband; changes no larger than it are not reported by SnapshotColumns::diff().
+ */
+class ColumnLayout
+{
+public:
+    static constexpr size_t NUM_TYPES = size_t(ETypeCode::OTHER) + 1;
+
+    struct Cell {
+        ETypeCode type;     // Column, VOID for the Data column
+        uint32_t row;
+    };
+
+    /**
+     * \brief Size of one cell of a dense column, or 0 if the type has no dense column
+     */
+    static size_t cellSize(ETypeCode type);
+
+    /**
+     * \param channels Channels of the monitor set
+     * \param deadbands Optional deadbands by channel name. Only applied to float and double channels
+     */
+    void build(const std::vector<DataSource::Channel>& channels, const std::unordered_map<std::string, double>* deadbands = nullptr);
+
+    inline size_t channels() const { return cells_.size(); }
+    inline const Cell& cell(size_t channel) const { return cells_[channel]; }
+
+    /**
+     * \brief Number of rows in the column of the given type. VOID is the Data column
+     */
+    inline size_t rows(ETypeCode type) const { return rows_[size_t(type)]; }
+
+    /**
+     * \brief Byte offset of a dense column within the column buffer
+     */
+    inline size_t offset(ETypeCode type) const { return offsets_[size_t(type)]; }
+
+    /**
+     * \brief Size of the buffer holding all dense columns, in 8 byte words
+     */
+    inline size_t words() const { return words_; }
+
+    /**
+     * \brief Returns the channel stored in a row of a column
+     */
+    inline size_t channelOf(ETypeCode type, size_t row) const { return rowChannels_[rowBase_[size_t(type)] + row]; }
+
+    /**
+     * \brief Per-row deadbands of the float and double columns, or nullptr if none were set
+     */
+    inline const float* floatDeadbands() const { return floatDeadbands_.empty() ? nullptr : floatDeadbands_.data(); }
+    inline const double* doubleDeadbands() const { return doubleDeadbands_.empty() ? nullptr : doubleDeadbands_.data(); }
+
+    /**
+     * \brief Returns the deadband of a channel, 0 if it has none
+     */
+    double deadband(size_t channel) const;
+
+private:
+    std::vector<Cell> cells_;       // 1:1 with the channels
+    std::vector<uint32_t> rowChannels_; // Inverse of cells_, column by column
+    std::vector<float> floatDeadbands_;
+    std::vector<double> doubleDeadbands_;
+    size_t rows_[NUM_TYPES] = {};
+    size_t rowBase_[NUM_TYPES] = {};
+    size_t offsets_[NUM_TYPES] = {};
+    size_t words_ = 0;
+};
+
+/**
+ * \brief Channel data of one snapshot, stored column by column as described by a ColumnLayout.
+ * All dense columns live in one buffer, each starting on an 8 byte boundary. Bytes between columns stay zero,
+ * so two snapshots of the same layout can be compared with a single memcmp of the buffer.
+ */
+class SnapshotColumns
+{
+public:
+    /**
+     * \brief Size the storage for a layout. Contents are unspecified afterwards
+     * \param layout Layout to use, must outlive this object (or the next reset())
+     */
+    void reset(const ColumnLayout& layout);
+
+    inline const ColumnLayout* layout() const { return layout_; }
+
+    /**
+     * \brief Store the value of a channel
+     * \returns False if the value's type doesn't match the channel's column. The cell is zeroed in that case
+     */
+    bool store(size_t channel, const Data& value);
+
+    /**
+     * \brief Returns the value of a channel
+     * Values in the Data column are returned directly, anything else is unpacked into tmp
+     */
+    const Data& load(size_t channel, Data& tmp) const;
+
+    /**
+     * \brief Returns true if the channel holds value. Compares bitwise, like Data's operator==
+     */
+    bool equals(size_t channel, const Data& value) const;
+
+    /**
+     * \brief Returns true if value differs from the channel by more than its deadband
+     */
+    bool changed(size_t channel, const Data& value) const;
+
+    /**
+     * \brief Find the channels that differ from prev by more than their deadband, using the vectorized kernels
+     * Both sides must use the same layout
+     * \param changed Bitmap, bit i % 64 of word i / 64 is set if channel i changed. Resized to fit the channels
+     * \param deadbands Apply the deadbands. If false, any change counts
+     * \returns Number of changed channels
+     */
+    size_t diff(const SnapshotColumns& prev, std::vector<uint64_t>& changed, bool deadbands = true) const;
+
+    /**
+     * \brief Compare every channel bitwise. Both sides must use the same layout
+     */
+    bool operator==(const SnapshotColumns& other) const;
+
+    inline bool operator!=(const SnapshotColumns& other) const {
+        return !(*this == other);
+    }
+
+    /**
+     * \brief Returns the dense column of type T, with layout()->rows() entries
+     */
+    template<typename T>
+    inline const T* column() const {
+        return reinterpret_cast<const T*>(reinterpret_cast<const char*>(words_.data()) + layout_->offset(type_code_for<T>()));
+    }
+
+    /**
+     * \brief Approximate heap memory held by this snapshot, in bytes
+     */
+    size_t memoryUsage() const;
+
+private:
+    inline char* cellPtr(const ColumnLayout::Cell& cell) {
+        return reinterpret_cast<char*>(words_.data()) + layout_->offset(cell.type) + cell.row * ColumnLayout::cellSize(cell.type);
+    }
+
+    inline const char* cellPtr(const ColumnLayout::Cell& cell) const {
+        return reinterpret_cast<const char*>(words_.data()) + layout_->offset(cell.type) + cell.row * ColumnLayout::cellSize(cell.type);
+    }
+
+    const ColumnLayout* layout_ = nullptr;
+    std::vector<uint64_t> words_;   // Dense columns
+    std::vector<Data> other_;       // Data column
+};
+
+} // namespace pvsave
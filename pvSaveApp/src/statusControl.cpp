@@ -64,6 +64,7 @@ struct SaveStatusDpvt {
     enum {
         Status,
         LastSaved,
+        LastChanged,
     } type;
     epicsInt32 monitorSet = -1;
 };
@@ -110,6 +111,9 @@ static long saveStatus_init_record(dbCommon* prec)
     else if (!epicsStrCaseCmp(instio, "lastSaved")) {
         dpvt->type = SaveStatusDpvt::LastSaved;
     }
+    else if (!epicsStrCaseCmp(instio, "lastChanged")) {
+        dpvt->type = SaveStatusDpvt::LastChanged;
+    }
     else {
         LOG_ERR("%s: Invalid INST_IO parameter '%s'\n", funcName, instio);
         delete dpvt;
@@ -137,6 +141,9 @@ static long saveStatus_read(longinRecord* prec)
     case SaveStatusDpvt::LastSaved:
         pr->val = lastProcTime(dpvt->monitorSet).secPastEpoch;
         break;
+    case SaveStatusDpvt::LastChanged:
+        pr->val = lastChangedTime(dpvt->monitorSet).secPastEpoch;
+        break;
     default:
         assert(0);
     }
@@ -321,6 +328,7 @@ static long saveStatusStr_read(stringinRecord* prec);
 struct SaveStatusStrDpvt {
     enum {
         LastSaved,
+        LastChanged,
     } type;
     epicsInt32 monitorSet = -1;
 };
@@ -353,16 +361,26 @@ static long saveStatusStr_init_record(dbCommon* prec)
     auto* pr = reinterpret_cast<stringinRecord*>(prec);
     auto* instio = pr->inp.value.instio.string;
     const size_t lastSavedLen = strlen("lastSaved");
+    const size_t lastChangedLen = strlen("lastChanged");
+    size_t len = 0;
     if (!epicsStrnCaseCmp(instio, "lastSaved", lastSavedLen)) {
-        if (*(instio + lastSavedLen)) {
-            if (epicsParseInt32(instio+lastSavedLen, &dpvt->monitorSet, 10, nullptr) != 0) {
+        dpvt->type = SaveStatusStrDpvt::LastSaved;
+        len = lastSavedLen;
+    }
+    else if (!epicsStrnCaseCmp(instio, "lastChanged", lastChangedLen)) {
+        dpvt->type = SaveStatusStrDpvt::LastChanged;
+        len = lastChangedLen;
+    }
+
+    if (len > 0) {
+        if (*(instio + len)) {
+            if (epicsParseInt32(instio+len, &dpvt->monitorSet, 10, nullptr) != 0) {
                 LOG_ERR("%s: Invalid INST_IO string '%s'\n", funcName, instio);
                 delete dpvt;
                 pr->dpvt = nullptr;
                 return -1;
             }
         }
-        dpvt->type = SaveStatusStrDpvt::LastSaved;
 
         strcpy(pr->val, "Never");
         pr->udf = FALSE;
@@ -392,9 +410,10 @@ static long saveStatusStr_read(stringinRecord* prec)
 
     switch(dpvt->type) {
     case SaveStatusStrDpvt::LastSaved:
+    case SaveStatusStrDpvt::LastChanged:
     {
         char time[MAX_STRING_SIZE] = {0};
-        auto ts = lastProcTime(dpvt->monitorSet);
+        auto ts = dpvt->type == SaveStatusStrDpvt::LastSaved ? lastProcTime(dpvt->monitorSet) : lastChangedTime(dpvt->monitorSet);
         epicsTimeToStrftime(time, sizeof(time), "%c", &ts);
         strncpy(prec->val, time, MAX_STRING_SIZE-1);
         prec->val[MAX_STRING_SIZE-1] = 0;
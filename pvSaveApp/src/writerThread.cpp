@@ -0,0 +1,292 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Per-backend writer threads that decouple snapshot capture from
+ *  backend I/O.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <string>
+#include <unordered_map>
+
+#include "dbScan.h"
+#include "epicsAlgorithm.h"
+#include "epicsExit.h"
+#include "epicsGuard.h"
+#include "epicsTime.h"
+
+#include "pvsave/serialize.h"
+
+#include "common.h"
+#include "diffKernel.h"
+#include "writerThread.h"
+
+using namespace pvsave;
+
+static std::unordered_map<SaveRestoreIO*, WriterThread*>& writers()
+{
+    static std::unordered_map<SaveRestoreIO*, WriterThread*> w;
+    return w;
+}
+
+static void stopWriters(void*)
+{
+    WriterThread::stopAll();
+}
+
+static void mergeChanged(std::vector<uint64_t>& into, const std::vector<uint64_t>& from)
+{
+    if (into.size() < from.size())
+        into.resize(from.size(), 0);
+    for (size_t w = 0; w < from.size(); ++w)
+        into[w] |= from[w];
+}
+
+WriterThread::WriterThread(SaveRestoreIO* io, size_t maxSets) :
+    io_(io)
+{
+    queue_.reserve(maxSets);
+}
+
+void WriterThread::queue(const std::shared_ptr<const Snapshot>& snap, uint32_t ioBit)
+{
+    {
+        epicsGuard<epicsMutex> guard(lock_);
+
+        // Replace a snapshot of the same set that hasn't been written yet
+        bool found = false;
+        for (auto& job : queue_) {
+            if (job.snap->channels == snap->channels) {
+                // Deltas written for the new snapshot must include what changed in the one it replaces
+                if (io_->flags() & SaveRestoreIO::Delta) {
+                    if (snap->sequence == job.snap->sequence + 1)
+                        mergeChanged(job.replaced, job.snap->changed);
+                    else if (snap->sequence != job.snap->sequence)
+                        job.baseSequence = ~uint64_t(0);    // Missed one, force a full write
+                }
+                job.snap = snap;
+                job.ioBit = ioBit;
+                ++replaced_;
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            if (queue_.size() == queue_.capacity()) {
+                // Only happens if a set that wasn't accounted for in startAll() writes here
+                LOG_ERR("pvSave: writer for %s is full, dropping snapshot of %s\n", io_->instanceName().c_str(), snap->setName);
+                return;
+            }
+            queue_.push_back({snap, ioBit, snap->sequence - 1, {}});
+        }
+    }
+    wakeup_.trigger();
+}
+
+bool WriterThread::writeSnapshot(SaveRestoreIO* io, const Snapshot& snap)
+{
+    if (!io->beginWrite()) {
+        LOG_ERR("pvSave: io->beginWrite: save failed\n");
+        return false;
+    }
+
+    bool ok = true;
+    Data tmp;
+    for (size_t i = 0; i < snap.channels->size(); ++i) {
+        if (!io->writeData((*snap.channels)[i], snap.data.load(i, tmp))) {
+            LOG_ERR("pvSave: io->writeData: save failed\n");
+            ok = false;
+            // Fall-through to allow cleanup
+        }
+        LOG_TRACE("wrote %s\n", (*snap.channels)[i].channelName.c_str());
+    }
+
+    if (!io->endWrite()) {
+        LOG_ERR("pvSave: io->endWrite: save failed\n");
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * Write a job, as a delta if the backend supports it and the job follows on from the last write
+ * \param delta Set to true if only changed channels were written
+ */
+bool WriterThread::write(const Job& job, bool& delta)
+{
+    const Snapshot& snap = *job.snap;
+    const bool chained = lastOk_ && lastSet_ == snap.channels;
+    // Periodic saves re-queue the last snapshot when nothing changed, that's a delta with nothing in it
+    const bool same = chained && snap.sequence == lastSequence_;
+
+    delta = (io_->flags() & SaveRestoreIO::Delta) && chained && (same || job.baseSequence == lastSequence_)
+        && io_->beginDelta();
+
+    bool ok = true;
+    if (delta) {
+        Data tmp;
+        const size_t words = same ? 0 : epicsMax(snap.changed.size(), job.replaced.size());
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t bits = (w < snap.changed.size() ? snap.changed[w] : 0) | (w < job.replaced.size() ? job.replaced[w] : 0);
+            while (bits) {
+                const size_t i = w * 64 + lowestBit(bits);
+                bits &= bits - 1;
+                if (i >= snap.channels->size())
+                    break;
+                if (!io_->writeData((*snap.channels)[i], snap.data.load(i, tmp))) {
+                    LOG_ERR("pvSave: io->writeData: save failed\n");
+                    ok = false;
+                }
+            }
+        }
+
+        if (!io_->endWrite()) {
+            LOG_ERR("pvSave: io->endWrite: save failed\n");
+            ok = false;
+        }
+    }
+    else
+        ok = writeSnapshot(io_, snap);
+
+    lastSet_ = snap.channels;
+    lastSequence_ = snap.sequence;
+    lastOk_ = ok;
+    return ok;
+}
+
+void WriterThread::run()
+{
+    while (1) {
+        wakeup_.wait();
+
+        while (1) {
+            Job job;
+            {
+                epicsGuard<epicsMutex> guard(lock_);
+                if (queue_.empty()) {
+                    if (stop_)
+                        return;
+                    break;
+                }
+                // FIFO keeps sets from starving each other
+                job = std::move(queue_.front());
+                queue_.erase(queue_.begin());
+            }
+
+            epicsTimeStamp start, end;
+            epicsTimeGetCurrent(&start);
+
+            bool delta;
+            bool ok = write(job, delta);
+
+            epicsTimeGetCurrent(&end);
+
+            if (ok)
+                job.snap->ioStatus->fetch_and(~job.ioBit);
+            else
+                job.snap->ioStatus->fetch_or(job.ioBit);
+
+            {
+                epicsGuard<epicsMutex> guard(lock_);
+                ++written_;
+                if (!ok)
+                    ++failed_;
+                if (delta)
+                    ++deltas_;
+                lastWriteTime_ = epicsTimeDiffInSeconds(&end, &start);
+            }
+
+            // Status records reflect the result of the write, which is only known now
+            scanIoRequest(*statusIoScan());
+        }
+    }
+}
+
+void WriterThread::threadProc(void* arg)
+{
+    static_cast<WriterThread*>(arg)->run();
+}
+
+void WriterThread::report(FILE* fp, int indent)
+{
+    epicsGuard<epicsMutex> guard(lock_);
+    pvsave::pindent(fp, indent);
+    fprintf(fp, "writer: %zu queued, %zu written (%zu deltas), %zu replaced, %zu failed, last write %.3f s\n",
+        queue_.size(), written_, deltas_, replaced_, failed_, lastWriteTime_);
+}
+
+WriterThread* WriterThread::find(SaveRestoreIO* io)
+{
+    auto it = writers().find(io);
+    return it == writers().end() ? nullptr : it->second;
+}
+
+void WriterThread::startAll(const std::vector<SaveRestoreIO*>& ios, unsigned int priority)
+{
+    std::unordered_map<SaveRestoreIO*, size_t> setCounts;
+    for (auto* io : ios)
+        setCounts[io]++;
+
+    for (auto& pair : setCounts) {
+        if (find(pair.first))
+            continue;
+
+        auto* writer = new WriterThread(pair.first, pair.second);
+
+        std::string name = "pvSaveW-" + pair.first->instanceName();
+
+        epicsThreadOpts opts;
+        opts.joinable = true;
+        opts.priority = priority;
+        opts.stackSize = epicsThreadStackMedium;
+        writer->thread_ = epicsThreadCreateOpt(name.c_str(), threadProc, writer, &opts);
+
+        // Without a writer, find() returns null and saves to this backend are written inline
+        if (!writer->thread_) {
+            LOG_ERR("pvSave: unable to start writer thread for %s, writing inline\n", pair.first->instanceName().c_str());
+            delete writer;
+            continue;
+        }
+        writers().insert({pair.first, writer});
+    }
+
+    // Registered after iocInit, so this runs before the database is torn down
+    static bool atExit = false;
+    if (!atExit && !writers().empty()) {
+        epicsAtExit(stopWriters, nullptr);
+        atExit = true;
+    }
+}
+
+void WriterThread::stopAll()
+{
+    for (auto& pair : writers()) {
+        WriterThread* writer = pair.second;
+        if (!writer->thread_)
+            continue;
+        {
+            epicsGuard<epicsMutex> guard(writer->lock_);
+            writer->stop_ = true;
+            if (!writer->queue_.empty())
+                LOG_INFO("pvSave: writing %zu queued snapshot(s) to %s before exit\n", writer->queue_.size(), pair.first->instanceName().c_str());
+        }
+        writer->wakeup_.trigger();
+    }
+
+    for (auto& pair : writers()) {
+        if (pair.second->thread_) {
+            epicsThreadMustJoin(pair.second->thread_);
+            pair.second->thread_ = nullptr;
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Per-backend writer threads that decouple snapshot capture from
+ *  backend I/O.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+
+#include "pvsave/pvSave.h"
+
+#include "snapshotColumns.h"
+
+namespace pvsave
+{
+
+/**
+ * \brief Immutable capture of a monitor set's channel data.
+ * Shared between the context that captured it and every writer it was queued on.
+ */
+struct Snapshot {
+    const char* setName = "";                                   // For log messages
+    const std::vector<DataSource::Channel>* channels = nullptr; // Owned by the context, also identifies the set
+    SnapshotColumns data;                                       // Values of *channels
+    std::vector<uint64_t> changed;                              // Bit per channel, set if it changed since the previous snapshot
+    uint64_t sequence = 0;                                      // Counts the snapshots of the set, so writers can tell if they missed one
+    std::shared_ptr<std::atomic<uint32_t>> ioStatus;            // One bit per IO backend of the set, set on failure
+};
+
+/**
+ * \brief Writes snapshots to a single SaveRestoreIO instance on a dedicated thread.
+ * The queue holds at most one snapshot per monitor set; queueing a newer snapshot for a set replaces
+ * the one that is still waiting, so a slow backend only ever falls behind by one snapshot.
+ * Backends with the Delta flag are only handed the channels that changed since the last snapshot they wrote. The changes of
+ * replaced snapshots are carried over, anything else that breaks the chain (a failed write, a different set) forces a full write.
+ */
+class WriterThread
+{
+public:
+    /**
+     * \param io Backend to write to
+     * \param maxSets Number of monitor sets writing to this backend. Bounds the queue
+     */
+    WriterThread(SaveRestoreIO* io, size_t maxSets);
+
+    /**
+     * \brief Queue a snapshot for writing
+     * \param snap Snapshot to write
+     * \param ioBit Bit to set/clear in snap->ioStatus once the write completes
+     */
+    void queue(const std::shared_ptr<const Snapshot>& snap, uint32_t ioBit);
+
+    void report(FILE* fp, int indent);
+
+    /**
+     * \brief Returns the writer for the given backend, or nullptr if writers have not been started
+     */
+    static WriterThread* find(SaveRestoreIO* io);
+
+    /**
+     * \brief Create and start a writer for every backend used by at least one monitor set
+     * \param ios Backends, one entry per monitor set using it
+     * \param priority Thread priority for the writers
+     */
+    static void startAll(const std::vector<SaveRestoreIO*>& ios, unsigned int priority);
+
+    /**
+     * \brief Write out what is still queued on every writer, then stop and join the writer threads.
+     * Registered with epicsAtExit by startAll(). Snapshots queued after this are not written
+     */
+    static void stopAll();
+
+    /**
+     * \brief Synchronously write a snapshot to a backend
+     * \returns True on success
+     */
+    static bool writeSnapshot(SaveRestoreIO* io, const Snapshot& snap);
+
+protected:
+    static void threadProc(void* arg);
+    void run();
+
+    struct Job {
+        std::shared_ptr<const Snapshot> snap;
+        uint32_t ioBit;
+        uint64_t baseSequence;          // Sequence of the snapshot the changes are relative to
+        std::vector<uint64_t> replaced; // Changes of the snapshots this one replaced, empty if none
+    };
+
+    bool write(const Job& job, bool& delta);
+
+    SaveRestoreIO* io_;
+    epicsThreadId thread_ = nullptr;
+    epicsMutex lock_;
+    epicsEvent wakeup_;
+    std::vector<Job> queue_;        // Guarded by lock_, never grows beyond maxSets
+    bool stop_ = false;             // Guarded by lock_, exit once the queue is empty
+
+    // Last write, only touched by the writer thread
+    const std::vector<DataSource::Channel>* lastSet_ = nullptr;
+    uint64_t lastSequence_ = 0;
+    bool lastOk_ = false;
+
+    // Stats
+    size_t written_ = 0;
+    size_t replaced_ = 0;
+    size_t failed_ = 0;
+    size_t deltas_ = 0;
+    double lastWriteTime_ = 0;
+};
+
+} // namespace pvsave
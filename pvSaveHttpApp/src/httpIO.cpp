@@ -62,7 +62,7 @@ public:
 
         strncat(line, channel.channelName.c_str(), sizeof(line) - 1);
         strncat(line, " ", sizeof(line) - 1);
-        strncat(line, pvsave::typeCodeString(value.type_code()), sizeof(line) - 1);
+        strncat(line, pvsave::dataTypeString(value), sizeof(line) - 1);
         strncat(line, " ", sizeof(line) - 1);
 
         char buf[MAX_LINE_LENGTH];
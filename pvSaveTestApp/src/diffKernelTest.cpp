@@ -0,0 +1,198 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Tests that the SIMD diff kernels agree with the scalar ones.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <vector>
+
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "diffKernel.h"
+
+using namespace pvsave;
+
+// Counts that exercise empty input, partial blocks and tails after whole blocks
+static const size_t COUNTS[] = {0, 1, 7, 31, 63, 64, 65, 127, 128, 129, 1000, 4099};
+
+static const EDiffKernel KERNELS[] = {EDiffKernel::Scalar, EDiffKernel::SSE2, EDiffKernel::AVX2};
+
+static uint64_t s_rand = 0x9E3779B97F4A7C15ull;
+
+static uint64_t nextRandom()
+{
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return s_rand * 2685821657736338717ull;
+}
+
+static size_t words(size_t count)
+{
+    return (count + 63) / 64;
+}
+
+/**
+ * Bitmap and change count of a diff, with guard words to catch writes past the end
+ */
+struct Result {
+    std::vector<uint64_t> bits;
+    size_t changed;
+
+    explicit Result(size_t count) : bits(words(count) + 1, 0xA5A5A5A5A5A5A5A5ull), changed(0) {}
+
+    bool operator==(const Result& other) const { return changed == other.changed && bits == other.bits; }
+};
+
+/**
+ * Reference semantics, written independently of the kernels
+ */
+template<typename T>
+static Result reference(const T* a, const T* b, const T* deadband, size_t count)
+{
+    Result r(count);
+    for (size_t w = 0; w < words(count); ++w)
+        r.bits[w] = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool changed = memcmp(&a[i], &b[i], sizeof(T)) != 0;
+        if (changed && deadband && fabs(double(a[i]) - double(b[i])) <= double(deadband[i]))
+            changed = false;
+        if (changed) {
+            r.bits[i / 64] |= uint64_t(1) << (i % 64);
+            ++r.changed;
+        }
+    }
+    return r;
+}
+
+template<typename T>
+static Result runBitwise(const std::vector<T>& a, const std::vector<T>& b, size_t count)
+{
+    Result r(count);
+    r.changed = diffBitwise(a.data(), b.data(), sizeof(T), count, r.bits.data());
+    return r;
+}
+
+template<typename T>
+static Result runDeadband(const std::vector<T>& a, const std::vector<T>& b, const std::vector<T>* deadband, size_t count)
+{
+    Result r(count);
+    r.changed = diffDeadband(a.data(), b.data(), deadband ? deadband->data() : nullptr, count, r.bits.data());
+    return r;
+}
+
+/**
+ * Bitwise comparison of 1, 2, 4 and 8 byte elements, with about one in eight elements changed
+ */
+template<typename T>
+static void testBitwise(EDiffKernel kernel)
+{
+    bool ok = true;
+    for (size_t count : COUNTS) {
+        std::vector<T> a(count), b(count);
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = b[i] = T(nextRandom());
+            if (nextRandom() % 8 == 0)
+                b[i] = T(b[i] ^ T(uint64_t(1) << (nextRandom() % (8 * sizeof(T)))));
+        }
+        // Always change the last element, so the tail is covered
+        if (count)
+            b[count - 1] = T(~a[count - 1]);
+
+        if (!(runBitwise(a, b, count) == reference<T>(a.data(), b.data(), nullptr, count))) {
+            testDiag("%s: %zu byte elements, count %zu differs from the reference", diffKernelName(kernel), sizeof(T), count);
+            ok = false;
+        }
+    }
+    testOk(ok, "%s: bitwise diff of %zu byte elements", diffKernelName(kernel), sizeof(T));
+}
+
+/**
+ * Floating point values with changes inside and outside the deadbands, NaNs, infinities and signed zeros
+ */
+template<typename T>
+static void testDeadband(EDiffKernel kernel)
+{
+    const T specials[] = {
+        std::numeric_limits<T>::quiet_NaN(),
+        -std::numeric_limits<T>::quiet_NaN(),
+        std::numeric_limits<T>::infinity(),
+        -std::numeric_limits<T>::infinity(),
+        T(0), -T(0),
+        std::numeric_limits<T>::denorm_min(),
+        std::numeric_limits<T>::max(),
+    };
+    constexpr size_t NUM_SPECIALS = sizeof(specials) / sizeof(specials[0]);
+
+    bool ok = true, okNull = true;
+    for (size_t count : COUNTS) {
+        std::vector<T> a(count), b(count), deadband(count);
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = T(int64_t(nextRandom() % 2000001) - 1000000) / T(1000);
+            deadband[i] = (nextRandom() % 4) ? T(nextRandom() % 100) / T(100) : T(0);
+            switch (nextRandom() % 8) {
+            case 0: b[i] = a[i] + deadband[i] / 2; break;       // Inside the deadband
+            case 1: b[i] = a[i] + deadband[i]; break;           // On the edge, still inside
+            case 2: b[i] = a[i] - deadband[i] * 2 - 1; break;   // Outside
+            case 3: b[i] = specials[nextRandom() % NUM_SPECIALS]; break;
+            case 4: a[i] = specials[nextRandom() % NUM_SPECIALS]; b[i] = a[i]; break;
+            case 5: a[i] = specials[nextRandom() % NUM_SPECIALS]; b[i] = specials[nextRandom() % NUM_SPECIALS]; break;
+            default: b[i] = a[i]; break;
+            }
+        }
+        if (count) {
+            a[count - 1] = std::numeric_limits<T>::quiet_NaN();
+            b[count - 1] = T(1);
+        }
+
+        if (!(runDeadband(a, b, &deadband, count) == reference(a.data(), b.data(), deadband.data(), count))) {
+            testDiag("%s: %zu byte deadband, count %zu differs from the reference", diffKernelName(kernel), sizeof(T), count);
+            ok = false;
+        }
+        if (!(runDeadband<T>(a, b, nullptr, count) == reference<T>(a.data(), b.data(), nullptr, count))) {
+            testDiag("%s: %zu byte without deadband, count %zu differs from the reference", diffKernelName(kernel), sizeof(T), count);
+            okNull = false;
+        }
+    }
+    testOk(ok, "%s: %s diff with deadbands, NaN and infinities", diffKernelName(kernel), sizeof(T) == 4 ? "float" : "double");
+    testOk(okNull, "%s: %s diff without deadbands", diffKernelName(kernel), sizeof(T) == 4 ? "float" : "double");
+}
+
+MAIN(diffKernelTest)
+{
+    constexpr int TESTS_PER_KERNEL = 8;
+    testPlan(TESTS_PER_KERNEL * int(sizeof(KERNELS) / sizeof(KERNELS[0])));
+
+    const EDiffKernel initial = diffKernel();
+    for (EDiffKernel kernel : KERNELS) {
+        if (!setDiffKernel(kernel)) {
+            testSkip(TESTS_PER_KERNEL, "kernel not supported by this CPU or build");
+            continue;
+        }
+        testDiag("Testing the %s kernels", diffKernelName(kernel));
+        testBitwise<uint8_t>(kernel);
+        testBitwise<uint16_t>(kernel);
+        testBitwise<uint32_t>(kernel);
+        testBitwise<uint64_t>(kernel);
+        testDeadband<float>(kernel);
+        testDeadband<double>(kernel);
+    }
+    setDiffKernel(initial);
+    return testDone();
+}
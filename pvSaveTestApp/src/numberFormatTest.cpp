@@ -0,0 +1,259 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Tests for numberFormat.h, with an opt-in exhaustive float32 round trip.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "epicsThread.h"
+#include "epicsThreadPool.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "numberFormat.h"
+
+using namespace pvsave;
+
+static bool sameFloat(float a, float b)
+{
+    uint32_t ua, ub;
+    memcpy(&ua, &a, sizeof(ua));
+    memcpy(&ub, &b, sizeof(ub));
+    return ua == ub || (isnan(a) && isnan(b));
+}
+
+/**
+ * Counts floats that don't survive formatFloat followed by parseNumber or strtof
+ */
+struct RoundTrip {
+    size_t checked = 0;
+    size_t parseBad = 0;        // parseNumber didn't give back the same float
+    size_t strtofBad = 0;       // strtof didn't give back the same float
+    uint32_t firstBad = 0;
+
+    void check(uint32_t bits)
+    {
+        char buf[NUMBER_BUFFER_SIZE + 1];
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        const size_t n = formatFloat(f, buf);
+        buf[n] = 0;
+
+        float parsed = 0;
+        const bool parseOk = parseNumber(buf, buf + n, parsed) == buf + n && sameFloat(parsed, f);
+        const bool strtofOk = sameFloat(strtof(buf, nullptr), f);
+        if (!parseOk || !strtofOk) {
+            if (!parseBad && !strtofBad)
+                firstBad = bits;
+            parseBad += !parseOk;
+            strtofBad += !strtofOk;
+        }
+        ++checked;
+    }
+
+    void report(const char* what)
+    {
+        if (parseBad || strtofBad)
+            testDiag("first mismatch at float bits 0x%08x", unsigned(firstBad));
+        testOk(parseBad == 0, "formatFloat -> parseNumber round trips %s (%zu floats, %zu mismatches)", what, checked, parseBad);
+        testOk(strtofBad == 0, "formatFloat -> strtof round trips %s (%zu floats, %zu mismatches)", what, checked, strtofBad);
+    }
+};
+
+/**
+ * Sampled round trip, fast enough for every test run: special values, both ends of the subnormal range,
+ * every power of two with its neighbours, and random bit patterns
+ */
+static void testFloatSample()
+{
+    RoundTrip rt;
+    for (uint32_t sign = 0; sign < 2; ++sign) {
+        const uint32_t s = sign << 31;
+        for (uint32_t bits : {0x00000000u, 0x7f800000u, 0x7fc00000u, 0x7f800001u, 0x7fffffffu, 0x7f7fffffu, 0x00800000u})
+            rt.check(s | bits);
+        // Smallest and largest subnormals, where the shortest digits are hardest to get right
+        for (uint32_t m = 1; m <= 0x10000; ++m) {
+            rt.check(s | m);
+            rt.check(s | (0x00800000u - m));
+        }
+        for (uint32_t e = 1; e < 255; ++e) {
+            const uint32_t pow2 = e << 23;
+            rt.check(s | pow2);
+            rt.check(s | (pow2 + 1));
+            rt.check(s | (pow2 - 1));
+        }
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < 4000000; ++i) {
+        // xorshift64*
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        rt.check(uint32_t((state * 2685821657736338717ull) >> 32));
+    }
+    rt.report("special, subnormal, power of two and random floats");
+}
+
+/**
+ * One slice of the float bit patterns, checked on a pool thread
+ */
+struct FloatSlice {
+    uint32_t first;
+    uint32_t count;
+    RoundTrip rt;
+
+    void run()
+    {
+        for (uint64_t u = first; u < uint64_t(first) + count; ++u)
+            rt.check(uint32_t(u));
+    }
+
+    static void jobFunc(void* arg, epicsJobMode mode)
+    {
+        if (mode == epicsJobModeRun)
+            static_cast<FloatSlice*>(arg)->run();
+    }
+};
+
+/**
+ * Every float32 bit pattern, split into slices checked on a thread pool. The whole run is about 25 CPU minutes,
+ * so it only runs when PVSAVE_TEST_EXHAUSTIVE is set in the environment
+ */
+static void testFloatExhaustive()
+{
+    constexpr uint32_t SLICES = 256;
+    constexpr uint32_t SLICE = uint32_t((uint64_t(1) << 32) / SLICES);
+    std::vector<FloatSlice> slices;
+    for (uint32_t i = 0; i < SLICES; ++i)
+        slices.push_back({i * SLICE, SLICE, {}});
+
+    epicsThreadPoolConfig conf;
+    epicsThreadPoolConfigDefaults(&conf);
+    epicsThreadPool* pool = epicsThreadPoolCreate(&conf);
+    std::vector<epicsJob*> jobs(slices.size(), nullptr);
+    for (size_t i = 0; pool && i < slices.size(); ++i) {
+        jobs[i] = epicsJobCreate(pool, FloatSlice::jobFunc, &slices[i]);
+        if (jobs[i] && epicsJobQueue(jobs[i]) != 0) {
+            epicsJobDestroy(jobs[i]);
+            jobs[i] = nullptr;
+        }
+    }
+    for (size_t i = 0; i < slices.size(); ++i) {
+        if (!jobs[i])
+            slices[i].run();
+    }
+    if (pool) {
+        epicsThreadPoolWait(pool, -1);
+        for (auto* job : jobs) {
+            if (job)
+                epicsJobDestroy(job);
+        }
+        epicsThreadPoolDestroy(pool);
+    }
+
+    RoundTrip total;
+    for (auto& slice : slices) {
+        if ((slice.rt.parseBad || slice.rt.strtofBad) && !total.parseBad && !total.strtofBad)
+            total.firstBad = slice.rt.firstBad;
+        total.checked += slice.rt.checked;
+        total.parseBad += slice.rt.parseBad;
+        total.strtofBad += slice.rt.strtofBad;
+    }
+    total.report("all 2^32 floats");
+}
+
+static void testFormat(const char* expected, size_t n, const char* buf)
+{
+    testOk(n == strlen(expected) && !memcmp(buf, expected, n), "formatted '%.*s', expected '%s'", int(n), buf, expected);
+}
+
+/**
+ * Shortest output for values printf would have written with 17 or 9 digits
+ */
+static void testShortest()
+{
+    char buf[NUMBER_BUFFER_SIZE];
+    testFormat("0.1", formatDouble(0.1, buf), buf);
+    testFormat("0.1", formatFloat(0.1f, buf), buf);
+    testFormat("1.2345678901234568e+17", formatDouble(123456789012345678.0, buf), buf);
+    testFormat("5e-324", formatDouble(5e-324, buf), buf);
+    testFormat("3.4028235e+38", formatFloat(3.4028235e38f, buf), buf);
+    testFormat("-0", formatDouble(-0.0, buf), buf);
+    testFormat("-inf", formatDouble(-INFINITY, buf), buf);
+    testFormat("-9223372036854775808", formatInteger(INT64_MIN, buf), buf);
+    testFormat("18446744073709551615", formatInteger(UINT64_MAX, buf), buf);
+}
+
+/**
+ * Range and sign handling of the integer parser
+ */
+static void testParseInteger()
+{
+    auto parse = [](const char* s, auto& out) {
+        return parseNumber(s, s + strlen(s), out) == s + strlen(s);
+    };
+    int8_t i8 = 0;
+    uint16_t u16 = 0;
+    int64_t i64 = 0;
+    uint64_t u64 = 0;
+    testOk(parse("-128", i8) && i8 == -128, "int8_t -128");
+    testOk(!parse("128", i8), "int8_t 128 overflows");
+    testOk(!parse("-1", u16), "uint16_t -1 is rejected");
+    testOk(parse("-0", u16) && u16 == 0, "uint16_t -0");
+    testOk(parse("-9223372036854775808", i64) && i64 == INT64_MIN, "int64_t minimum");
+    testOk(!parse("9223372036854775808", i64), "int64_t maximum + 1 overflows");
+    testOk(parse("18446744073709551615", u64) && u64 == UINT64_MAX, "uint64_t maximum");
+    testOk(!parse("18446744073709551616", u64), "uint64_t maximum + 1 overflows");
+}
+
+/**
+ * Valid numbers longer than the slow path's stack buffer must be read in full, not cut short
+ */
+static void testParseLong()
+{
+    const std::string small = "0." + std::string(299, '0') + "1";
+    double d = 0;
+    const char* end = parseNumber(small.data(), small.data() + small.size(), d);
+    testOk(end == small.data() + small.size() && d == 1e-300, "%zu character 1e-300 parses in full (got %g)", small.size(), d);
+
+    const std::string large = "1" + std::string(300, '0') + ".5";
+    d = 0;
+    end = parseNumber(large.data(), large.data() + large.size(), d);
+    testOk(end == large.data() + large.size() && d == 1e300, "%zu character 1e300 parses in full (got %g)", large.size(), d);
+
+    const std::string trailing = std::string(200, '9') + "x";
+    d = 0;
+    end = parseNumber(trailing.data(), trailing.data() + trailing.size(), d);
+    testOk(end == trailing.data() + 200, "200 digits followed by garbage stop at the garbage");
+}
+
+MAIN(numberFormatTest)
+{
+    testPlan(24);
+    testShortest();
+    testParseInteger();
+    testParseLong();
+    testFloatSample();
+    if (getenv("PVSAVE_TEST_EXHAUSTIVE"))
+        testFloatExhaustive();
+    else
+        testSkip(2, "exhaustive float round trip, set PVSAVE_TEST_EXHAUSTIVE to run it");
+    return testDone();
+}
@@ -0,0 +1,523 @@
+/**
+ * ----------------------------------------------------------------------------
+ * Company    : SLAC National Accelerator Laboratory
+ * ----------------------------------------------------------------------------
+ * Description: Microbenchmarks for the save and restore paths.
+ *  Run with no arguments for all of them, or name the ones to run.
+ * ----------------------------------------------------------------------------
+ * This file is part of 'pvSave'. It is subject to the license terms in the
+ * LICENSE.txt file found in the top-level directory of this distribution,
+ * and at:
+ *    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of 'pvSave', including this file, may be copied, modified,
+ * propagated, or distributed except according to the terms contained in the
+ * LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+ **/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "epicsTime.h"
+#include "iocsh.h"
+
+#include "pvsave/pvSave.h"
+
+#include "channelIndex.h"
+#include "diffKernel.h"
+#include "legacyVariant.h"
+#include "numberFormat.h"
+
+using namespace pvsave;
+
+// Registers pvSave_ConfigureFileSystemIO, normally done through pvSave.dbd
+void registerFSIO();
+
+static uint64_t s_rand = 0x9E3779B97F4A7C15ull;
+
+static uint64_t nextRandom()
+{
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return s_rand * 2685821657736338717ull;
+}
+
+/**
+ * Runs func the given number of times and returns the fastest run, in seconds
+ */
+template<typename F>
+static double bestOf(int runs, F&& func)
+{
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+        const epicsUInt64 start = epicsMonotonicGet();
+        func();
+        const double t = double(epicsMonotonicGet() - start) * 1e-9;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+//-------------------------------------------------------------------------//
+// Diff kernels
+
+static const EDiffKernel KERNELS[] = {EDiffKernel::Scalar, EDiffKernel::SSE2, EDiffKernel::AVX2};
+
+/**
+ * Times every supported kernel on the same input and prints the time per element and per array
+ */
+template<typename F>
+static void timeKernels(const char* what, size_t count, size_t bytes, F&& diff)
+{
+    const EDiffKernel initial = diffKernel();
+    for (EDiffKernel kernel : KERNELS) {
+        if (!setDiffKernel(kernel))
+            continue;
+        size_t changed = 0;
+        const double t = bestOf(20, [&] { changed = diff(); });
+        printf("  %-18s %-6s %8.3f ms  %6.3f ns/element  %6.2f GB/s  (%zu changed)\n", what, diffKernelName(kernel),
+            t * 1e3, t * 1e9 / count, 2.0 * bytes / t * 1e-9, changed);
+    }
+    setDiffKernel(initial);
+}
+
+template<typename T>
+static void benchBitwise(size_t count)
+{
+    std::vector<T> a(count), b;
+    for (auto& v : a)
+        v = T(nextRandom());
+    b = a;
+    // About one element in a thousand changes between snapshots
+    for (size_t i = 0; i < count / 1000; ++i)
+        b[nextRandom() % count] ^= T(1);
+
+    std::vector<uint64_t> bits((count + 63) / 64);
+    char what[32];
+    snprintf(what, sizeof(what), "bitwise %zu byte", sizeof(T));
+    timeKernels(what, count, count * sizeof(T), [&] { return diffBitwise(a.data(), b.data(), sizeof(T), count, bits.data()); });
+}
+
+template<typename T>
+static void benchDeadband(size_t count)
+{
+    std::vector<T> a(count), b(count), deadband(count);
+    for (size_t i = 0; i < count; ++i) {
+        a[i] = T(int64_t(nextRandom() % 2000001) - 1000000) / T(1000);
+        deadband[i] = (i % 3) ? T(0.5) : T(0);
+        // Noise inside the deadband on most elements, a real change on a few
+        b[i] = a[i] + ((nextRandom() % 1000) ? T(0.25) : T(10));
+    }
+
+    std::vector<uint64_t> bits((count + 63) / 64);
+    const char* name = sizeof(T) == 4 ? "float" : "double";
+    char what[32];
+    snprintf(what, sizeof(what), "%s deadband", name);
+    timeKernels(what, count, count * sizeof(T), [&] { return diffDeadband(a.data(), b.data(), deadband.data(), count, bits.data()); });
+    snprintf(what, sizeof(what), "%s no deadband", name);
+    timeKernels(what, count, count * sizeof(T), [&] { return diffDeadband(a.data(), b.data(), nullptr, count, bits.data()); });
+}
+
+static void benchDiff()
+{
+    constexpr size_t COUNT = 1000000;
+    printf("Diff of two %zu element arrays, best of 20 runs (default kernel: %s)\n", COUNT, diffKernelName(diffKernel()));
+    benchBitwise<uint8_t>(COUNT);
+    benchBitwise<uint16_t>(COUNT);
+    benchBitwise<uint32_t>(COUNT);
+    benchBitwise<uint64_t>(COUNT);
+    benchDeadband<float>(COUNT);
+    benchDeadband<double>(COUNT);
+}
+
+//-------------------------------------------------------------------------//
+// Variant
+
+/** Data as it was before the ETypeCode dispatch rewrite */
+using LegacyData = pvsaveLegacy::Variant<int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t, float,
+    double, std::string>;
+
+static void setString(LegacyData& d, const char* str) { d.construct<std::string>(str); }
+static void setString(Data& d, const char* str) { d.construct<DbString>(str); }
+
+/**
+ * Per element cost of what a save cycle does to each slot: store a new value, copy it, read it back and move it.
+ * One element in ten is a string, as for a typical mix of ai/ao and stringin/mbbi records
+ */
+template<typename D>
+static void benchVariantOps(const char* name)
+{
+    constexpr size_t COUNT = 1000000;
+    std::vector<D> a(COUNT), b(COUNT), c;
+
+    const double construct = bestOf(5, [&] {
+        for (size_t i = 0; i < COUNT; ++i) {
+            if (i % 10 == 0)
+                setString(a[i], "IOC:SYS:STATE");
+            else
+                a[i].template construct<double>(i * 1.5);
+        }
+    });
+    const double copy = bestOf(5, [&] {
+        for (size_t i = 0; i < COUNT; ++i)
+            b[i] = a[i];
+    });
+    double sum = 0;
+    const double get = bestOf(5, [&] {
+        for (size_t i = 0; i < COUNT; ++i) {
+            if (auto* v = b[i].template get<double>())
+                sum += *v;
+        }
+    });
+    const double move = bestOf(5, [&] {
+        c.clear();
+        c.reserve(COUNT);
+        for (size_t i = 0; i < COUNT; ++i)
+            c.push_back(std::move(a[i]));
+        a.swap(c);
+    });
+
+    printf("  %-8s sizeof %3zu  construct %6.2f ns  copy %6.2f ns  get %6.2f ns  move %6.2f ns  (sum %g)\n", name, sizeof(D),
+        construct * 1e9 / COUNT, copy * 1e9 / COUNT, get * 1e9 / COUNT, move * 1e9 / COUNT, sum);
+}
+
+static void benchVariant()
+{
+    printf("Variant, per element over 1M elements, best of 5 runs\n");
+    benchVariantOps<LegacyData>("legacy");
+    benchVariantOps<Data>("current");
+}
+
+//-------------------------------------------------------------------------//
+// File backends
+
+/**
+ * Channels with a typical mix of values: doubles, integers, enums, strings and floats
+ */
+struct SyntheticSet {
+    std::vector<DataSource::Channel> channels;
+    std::vector<Data> values;
+
+    explicit SyntheticSet(size_t count)
+    {
+        channels.reserve(count);
+        values.resize(count);
+        char name[64];
+        for (size_t i = 0; i < count; ++i) {
+            snprintf(name, sizeof(name), "IOC:SYS:DEV%zu:SIGNAL_%zu", i % 100, i);
+            channels.push_back({name, nullptr});
+            switch (i % 5) {
+            case 0: values[i].construct<double>(double(int64_t(nextRandom() % 2000001) - 1000000) / 1000); break;
+            case 1: values[i].construct<int32_t>(int32_t(nextRandom())); break;
+            case 2: values[i].construct<uint16_t>(uint16_t(nextRandom() % 16)); break;
+            case 3: snprintf(name, sizeof(name), "STATE_%zu", i % 7); values[i].construct<DbString>(name); break;
+            case 4: values[i].construct<float>(float(nextRandom() % 100000) * 0.01f); break;
+            }
+        }
+    }
+};
+
+/**
+ * Creates a fileSystemIO through its iocsh command, the only way to construct one outside the library
+ */
+static SaveRestoreIO* configureFileIO(const char* name, const char* path, const char* format)
+{
+    static bool registered = false;
+    if (!registered) {
+        registerFSIO();
+        registered = true;
+    }
+    std::string cmd = std::string("pvSave_ConfigureFileSystemIO ") + name + " " + path + " " + format;
+    if (iocshCmd(cmd.c_str()) != 0)
+        return nullptr;
+    auto it = ioBackends().find(name);
+    return it == ioBackends().end() ? nullptr : it->second;
+}
+
+static bool writeSet(SaveRestoreIO* io, const SyntheticSet& set)
+{
+    bool ok = io->beginWrite();
+    for (size_t i = 0; ok && i < set.channels.size(); ++i)
+        ok = io->writeData(set.channels[i], set.values[i]);
+    return io->endWrite() && ok;
+}
+
+template<typename Sink>
+static bool readSet(SaveRestoreIO* io, Sink& sink)
+{
+    if (!io->beginRead())
+        return false;
+    const bool ok = io->readStream(sink);
+    return io->endRead() && ok;
+}
+
+static double fileMegabytes(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? double(st.st_size) / (1024 * 1024) : 0;
+}
+
+/** Counts what the backend hands over, with the same per-value work a restore does before dbPut */
+class CountingSink : public RestoreSink
+{
+public:
+    size_t values = 0;
+    size_t nameBytes = 0;
+
+    void onData(const char* name, size_t nameLen, const Data& value) override
+    {
+        ++values;
+        nameBytes += nameLen;
+        held_ = value;
+    }
+
+private:
+    Data held_;
+};
+
+/**
+ * Number parsing on its own, over values as they appear in save files
+ */
+static void benchParseNumbers(size_t count)
+{
+    std::vector<char> text;
+    std::vector<size_t> ends;
+    char buf[NUMBER_BUFFER_SIZE];
+    for (size_t i = 0; i < count; ++i) {
+        const size_t n = (i % 2) ? formatInteger(int64_t(nextRandom() % 2000001) - 1000000, buf)
+                                 : formatDouble(double(int64_t(nextRandom() % 2000001) - 1000000) / 1000, buf);
+        text.insert(text.end(), buf, buf + n);
+        text.push_back(0);
+        ends.push_back(text.size() - 1);
+    }
+
+    double sum = 0;
+    const double tStrtod = bestOf(3, [&] {
+        const char* p = text.data();
+        for (size_t i = 0; i < count; ++i) {
+            sum += (i % 2) ? double(strtoll(p, nullptr, 10)) : strtod(p, nullptr);
+            p = text.data() + ends[i] + 1;
+        }
+    });
+    const double tParse = bestOf(3, [&] {
+        const char* p = text.data();
+        for (size_t i = 0; i < count; ++i) {
+            const char* end = text.data() + ends[i];
+            if (i % 2) {
+                int64_t v = 0;
+                parseNumber(p, end, v);
+                sum += double(v);
+            }
+            else {
+                double v = 0;
+                parseNumber(p, end, v);
+                sum += v;
+            }
+            p = end + 1;
+        }
+    });
+    printf("  %zu numbers, half doubles, half integers (sum %g)\n", count, sum);
+    printf("    strtod/strtoll %8.1f ms  %6.1f ns/value\n", tStrtod * 1e3, tStrtod * 1e9 / count);
+    printf("    parseNumber    %8.1f ms  %6.1f ns/value\n", tParse * 1e3, tParse * 1e9 / count);
+}
+
+static void benchText()
+{
+    constexpr size_t COUNT = 1000000;
+    const char* path = "pvSaveBench.sav";
+    printf("Text save file with %zu lines\n", COUNT);
+
+    SyntheticSet set(COUNT);
+    SaveRestoreIO* io = configureFileIO("pvSaveBenchText", path, "text");
+    if (!io) {
+        printf("  unable to create the text backend\n");
+        return;
+    }
+
+    bool ok = true;
+    const double tWrite = bestOf(1, [&] { ok = writeSet(io, set); });
+    const double mb = fileMegabytes(path);
+    if (!ok) {
+        printf("  writing %s failed\n", path);
+        return;
+    }
+    printf("  write            %8.1f ms  %6.2f Mlines/s  %7.1f MB/s  (%.1f MB)\n", tWrite * 1e3, COUNT / tWrite * 1e-6, mb / tWrite, mb);
+
+    size_t values = 0;
+    const double tRead = bestOf(3, [&] {
+        CountingSink sink;
+        ok = readSet(io, sink);
+        values = sink.values;
+    });
+    printf("  readStream       %8.1f ms  %6.2f Mlines/s  %7.1f MB/s  (%zu values%s)\n", tRead * 1e3, COUNT / tRead * 1e-6, mb / tRead,
+        values, ok ? "" : ", failed");
+
+    remove(path);
+    benchParseNumbers(COUNT);
+}
+
+/**
+ * Restores into a channel list through onData() only, so every value is parsed before its name is looked up
+ */
+class IndexSink : public RestoreSink
+{
+public:
+    IndexSink(const ChannelIndex& index, std::vector<Data>& values) : index_(index), values_(values) {}
+
+    void onData(const char* name, size_t nameLen, const Data& value) override
+    {
+        const size_t i = index_.find(name, nameLen, next_);
+        if (i == ChannelIndex::npos) {
+            ++unknown;
+            return;
+        }
+        next_ = i + 1;
+        values_[i] = value;
+        ++restored;
+    }
+
+    size_t restored = 0;
+    size_t unknown = 0;
+
+protected:
+    const ChannelIndex& index_;
+    std::vector<Data>& values_;
+    size_t next_ = 0;
+};
+
+/**
+ * Same as IndexSink, but resolves names first so the backend can skip the values of unknown channels, like SaveContext does
+ */
+class ResolvingSink : public IndexSink
+{
+public:
+    using IndexSink::IndexSink;
+
+    size_t resolve(const char* name, size_t nameLen) override
+    {
+        const size_t i = index_.find(name, nameLen, next_);
+        if (i == ChannelIndex::npos) {
+            ++unknown;
+            return UNKNOWN;
+        }
+        next_ = i + 1;
+        return i;
+    }
+
+    void onResolved(size_t channel, const char*, size_t, const Data& value) override
+    {
+        values_[channel] = value;
+        ++restored;
+    }
+};
+
+static void benchJson()
+{
+    constexpr size_t COUNT = 500000;
+    const char* path = "pvSaveBench.jsav";
+    printf("JSON save file with %zu entries, one in ten not in the restored set\n", COUNT);
+
+    SyntheticSet set(COUNT);
+    SaveRestoreIO* io = configureFileIO("pvSaveBenchJson", path, "json");
+    if (!io || !writeSet(io, set)) {
+        printf("  unable to write %s\n", path);
+        return;
+    }
+    const double mb = fileMegabytes(path);
+
+    // Channels that were removed from the set since the file was written
+    std::vector<std::string> names;
+    for (size_t i = 0; i < COUNT; ++i) {
+        if (i % 10 != 9)
+            names.push_back(set.channels[i].channelName);
+    }
+    ChannelIndex index;
+    index.build(names);
+    std::vector<Data> values(names.size());
+
+    auto report = [&](const char* what, double t, size_t restored, bool ok) {
+        printf("  %-22s %8.1f ms  %6.2f Mentries/s  %7.1f MB/s  (%zu restored%s)\n", what, t * 1e3, COUNT / t * 1e-6, mb / t,
+            restored, ok ? "" : ", failed");
+    };
+
+    bool ok = true;
+    size_t restored = 0;
+    double t = bestOf(3, [&] {
+        std::unordered_map<std::string, Data> pvs;
+        ok = io->beginRead() && io->readData(pvs);
+        io->endRead();
+        restored = 0;
+        for (auto& name : names)
+            restored += pvs.count(name);
+    });
+    report("readData into a map", t, restored, ok);
+
+    t = bestOf(3, [&] {
+        IndexSink sink(index, values);
+        ok = readSet(io, sink);
+        restored = sink.restored;
+    });
+    report("readStream, onData", t, restored, ok);
+
+    t = bestOf(3, [&] {
+        ResolvingSink sink(index, values);
+        ok = readSet(io, sink);
+        restored = sink.restored;
+    });
+    report("readStream, resolve", t, restored, ok);
+
+    remove(path);
+}
+
+//-------------------------------------------------------------------------//
+
+struct Bench {
+    const char* name;
+    const char* description;
+    void (*func)();
+};
+
+static const Bench BENCHES[] = {
+    {"diff", "scalar, SSE2 and AVX2 diff kernels on 1M element arrays", benchDiff},
+    {"variant", "Data against the Variant it replaced, per element", benchVariant},
+    {"text", "write and read a 1M line text save file, and number parsing", benchText},
+    {"json", "read a 500k entry JSON save file through readData and readStream", benchJson},
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        for (auto& bench : BENCHES) {
+            bench.func();
+            printf("\n");
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const Bench* found = nullptr;
+        for (auto& bench : BENCHES) {
+            if (!strcmp(bench.name, argv[i]))
+                found = &bench;
+        }
+        if (!found) {
+            printf("Usage: %s [benchmark...]\n", argv[0]);
+            for (auto& bench : BENCHES)
+                printf("  %-8s %s\n", bench.name, bench.description);
+            return 1;
+        }
+        found->func();
+        printf("\n");
+    }
+    return 0;
+}